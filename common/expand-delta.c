@@ -0,0 +1,443 @@
+/*
+	Copyright (C) 2004, 2005 Stephen Bach
+	This file is part of the Viewglob package.
+
+	Viewglob is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Viewglob is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Viewglob; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* Deltas between binary expansion results.  Most keystrokes change little
+   of what's shown (a file's selection, a count), so vgseer sends vgd the
+   difference from the last results rather than the whole thing, and vgd
+   rebuilds the full results from it.
+
+   A delta is EXPAND_DELTA_MAGIC and the 32-bit generation of the results
+   it applies to, followed by a directive per directory of the new results:
+
+	DD_SAME  index            The old directory at index, unchanged.
+	ER_DIR   ...              A whole directory, exactly as in the binary
+	                          results (or an ER_INCOMPLETE one).
+	DD_PATCH index header     The old directory at index with a new header
+	                          (the ER_DIR record minus its type byte),
+	                          followed by file directives which walk through
+	                          the old directory's files:
+	    DD_KEEP n                 Copy the next n old files.
+	    DD_SKIP n                 Drop the next n old files.
+	    ER_FILE ...               A new file record.
+
+   Old files left over at the end of a patch are dropped.  Only complete
+   directories are patched, and only from complete ones.  Integers are in
+   network byte order. */
+
+#include "config.h"
+
+#include "common.h"
+#include "expand.h"
+#include <string.h>
+
+enum delta_directive {
+	DD_SAME  = 'S',
+	DD_PATCH = 'P',
+	DD_KEEP  = 'K',
+	DD_SKIP  = 'X',
+};
+
+/* A record within some results. */
+struct span {
+	const gchar* start;
+	gsize len;
+	const gchar* name;
+};
+
+/* A directory and its files within some results. */
+struct dir_span {
+	struct span header;
+	GArray* files;       /* Of struct span. */
+	gsize block_len;     /* Header and files together. */
+};
+
+static GArray*  index_results(const gchar* data, gsize len);
+static void     free_index(GArray* dirs);
+static gboolean next_record(const gchar** p, const gchar* end,
+		struct span* record);
+static gboolean measure(const gchar** p, const gchar* end, gsize fixed,
+		struct span* record);
+static void     diff_dir(GString* out, guint32 index,
+		const struct dir_span* old, const struct dir_span* new);
+static void     flush_keep(GString* out, guint32* keep);
+static void     append_u32(GString* out, guint32 n);
+static gboolean read_u32(const gchar** p, const gchar* end, guint32* n);
+
+
+/* Write the delta from old_results (generation gen) to new_results into
+   delta.  Returns FALSE if a delta can't be made, in which case the full
+   results should be sent. */
+gboolean expand_delta_make(GString* delta, const GString* old_results,
+		guint32 gen, const GString* new_results) {
+
+	g_return_val_if_fail(delta != NULL, FALSE);
+	g_return_val_if_fail(old_results != NULL, FALSE);
+	g_return_val_if_fail(new_results != NULL, FALSE);
+
+	GArray* old_dirs;
+	GArray* new_dirs;
+	GTree* old_names;
+	struct dir_span* old;
+	struct dir_span* new;
+	gpointer index;
+	guint i;
+
+	old_dirs = index_results(old_results->str, old_results->len);
+	new_dirs = index_results(new_results->str, new_results->len);
+	if (!old_dirs || !new_dirs) {
+		free_index(old_dirs);
+		free_index(new_dirs);
+		return FALSE;
+	}
+
+	/* Directories are matched up by name. */
+	old_names = g_tree_new((GCompareFunc) strcmp);
+	for (i = 0; i < old_dirs->len; i++) {
+		old = &g_array_index(old_dirs, struct dir_span, i);
+		g_tree_insert(old_names, (gpointer) old->header.name,
+				GUINT_TO_POINTER(i + 1));
+	}
+
+	delta = g_string_truncate(delta, 0);
+	delta = g_string_append_c(delta, EXPAND_DELTA_MAGIC);
+	append_u32(delta, gen);
+
+	for (i = 0; i < new_dirs->len; i++) {
+		new = &g_array_index(new_dirs, struct dir_span, i);
+		index = g_tree_lookup(old_names, new->header.name);
+
+		if (!index) {
+			/* Never seen it. */
+			delta = g_string_append_len(delta, new->header.start,
+					new->block_len);
+			continue;
+		}
+
+		old = &g_array_index(old_dirs, struct dir_span,
+				GPOINTER_TO_UINT(index) - 1);
+		if (old->block_len == new->block_len &&
+				memcmp(old->header.start, new->header.start,
+					new->block_len) == 0) {
+			delta = g_string_append_c(delta, DD_SAME);
+			append_u32(delta, GPOINTER_TO_UINT(index) - 1);
+		}
+		else if (*old->header.start == ER_DIR &&
+				*new->header.start == ER_DIR)
+			diff_dir(delta, GPOINTER_TO_UINT(index) - 1, old, new);
+		else {
+			delta = g_string_append_len(delta, new->header.start,
+					new->block_len);
+		}
+	}
+
+	g_tree_destroy(old_names);
+	free_index(old_dirs);
+	free_index(new_dirs);
+	return TRUE;
+}
+
+
+/* Rebuild the full results in results from old_results (generation gen)
+   and the delta.  Returns FALSE if the delta is malformed or was made
+   against some other generation. */
+gboolean expand_delta_apply(GString* results, const GString* old_results,
+		guint32 gen, const gchar* delta, gsize len) {
+
+	g_return_val_if_fail(results != NULL, FALSE);
+	g_return_val_if_fail(old_results != NULL, FALSE);
+	g_return_val_if_fail(delta != NULL, FALSE);
+
+	const gchar* p = delta;
+	const gchar* end = delta + len;
+	GArray* old_dirs;
+	struct dir_span* old = NULL;
+	struct span record;
+	guint32 n;
+	guint cursor = 0;
+	gboolean ok = FALSE;
+
+	if (len < 1 || *p++ != EXPAND_DELTA_MAGIC)
+		return FALSE;
+	if (!read_u32(&p, end, &n) || n != gen)
+		return FALSE;
+
+	old_dirs = index_results(old_results->str, old_results->len);
+	if (!old_dirs)
+		return FALSE;
+
+	results = g_string_truncate(results, 0);
+	results = g_string_append_c(results, EXPAND_DATA_MAGIC);
+
+	while (p < end) {
+		switch (*p) {
+			case DD_SAME:
+				p++;
+				if (!read_u32(&p, end, &n) || n >= old_dirs->len)
+					goto done;
+				old = &g_array_index(old_dirs, struct dir_span, n);
+				results = g_string_append_len(results, old->header.start,
+						old->block_len);
+				old = NULL;
+				break;
+
+			case ER_DIR:
+			case ER_INCOMPLETE:
+				if (!next_record(&p, end, &record))
+					goto done;
+				results = g_string_append_len(results, record.start,
+						record.len);
+				old = NULL;
+				break;
+
+			case DD_PATCH:
+				p++;
+				if (!read_u32(&p, end, &n) || n >= old_dirs->len)
+					goto done;
+				old = &g_array_index(old_dirs, struct dir_span, n);
+				cursor = 0;
+
+				/* The header is sent without its type byte. */
+				if (!measure(&p, end, 3 * sizeof(guint32), &record))
+					goto done;
+				results = g_string_append_c(results, ER_DIR);
+				results = g_string_append_len(results, record.start,
+						record.len);
+				break;
+
+			case ER_FILE:
+				if (!next_record(&p, end, &record))
+					goto done;
+				results = g_string_append_len(results, record.start,
+						record.len);
+				break;
+
+			case DD_KEEP:
+				p++;
+				if (!old || !read_u32(&p, end, &n) ||
+						n > old->files->len - cursor)
+					goto done;
+				for (; n > 0; n--, cursor++) {
+					record = g_array_index(old->files, struct span, cursor);
+					results = g_string_append_len(results, record.start,
+							record.len);
+				}
+				break;
+
+			case DD_SKIP:
+				p++;
+				if (!old || !read_u32(&p, end, &n) ||
+						n > old->files->len - cursor)
+					goto done;
+				cursor += n;
+				break;
+
+			default:
+				goto done;
+		}
+	}
+	ok = TRUE;
+
+done:
+	free_index(old_dirs);
+	return ok;
+}
+
+
+/* Write the directives to turn old into new. */
+static void diff_dir(GString* out, guint32 index,
+		const struct dir_span* old, const struct dir_span* new) {
+	GString* patch;
+	GTree* old_names;
+	struct span* file;
+	struct span* old_file;
+	gpointer found;
+	guint32 keep = 0;
+	guint i, j;
+	guint cursor = 0;
+
+	patch = g_string_sized_new(64);
+	patch = g_string_append_c(patch, DD_PATCH);
+	append_u32(patch, index);
+	patch = g_string_append_len(patch, new->header.start + 1,
+			new->header.len - 1);
+
+	old_names = g_tree_new((GCompareFunc) strcmp);
+	for (i = 0; i < old->files->len; i++) {
+		file = &g_array_index(old->files, struct span, i);
+		g_tree_insert(old_names, (gpointer) file->name,
+				GUINT_TO_POINTER(i + 1));
+	}
+
+	for (i = 0; i < new->files->len; i++) {
+		file = &g_array_index(new->files, struct span, i);
+		found = g_tree_lookup(old_names, file->name);
+
+		if (found && (j = GPOINTER_TO_UINT(found) - 1) >= cursor) {
+			/* Catch up to it. */
+			if (j > cursor) {
+				flush_keep(patch, &keep);
+				patch = g_string_append_c(patch, DD_SKIP);
+				append_u32(patch, j - cursor);
+				cursor = j;
+			}
+
+			old_file = &g_array_index(old->files, struct span, j);
+			if (old_file->len == file->len &&
+					memcmp(old_file->start, file->start, file->len) == 0)
+				keep++;
+			else {
+				/* Its selection or type changed. */
+				flush_keep(patch, &keep);
+				patch = g_string_append_c(patch, DD_SKIP);
+				append_u32(patch, 1);
+				patch = g_string_append_len(patch, file->start, file->len);
+			}
+			cursor++;
+		}
+		else {
+			flush_keep(patch, &keep);
+			patch = g_string_append_len(patch, file->start, file->len);
+		}
+	}
+	flush_keep(patch, &keep);
+
+	/* Don't bother if it's no smaller than the directory itself. */
+	if (patch->len < new->block_len)
+		out = g_string_append_len(out, patch->str, patch->len);
+	else
+		out = g_string_append_len(out, new->header.start, new->block_len);
+
+	g_tree_destroy(old_names);
+	g_string_free(patch, TRUE);
+}
+
+
+static void flush_keep(GString* out, guint32* keep) {
+	if (*keep > 0) {
+		out = g_string_append_c(out, DD_KEEP);
+		append_u32(out, *keep);
+		*keep = 0;
+	}
+}
+
+
+/* Find the directories and files in binary results.  Returns NULL if they
+   aren't well formed. */
+static GArray* index_results(const gchar* data, gsize len) {
+	GArray* dirs;
+	struct dir_span dir;
+	struct dir_span* current = NULL;
+	struct span record;
+	const gchar* p = data;
+	const gchar* end = data + len;
+
+	if (len < 1 || *p++ != EXPAND_DATA_MAGIC)
+		return NULL;
+
+	dirs = g_array_new(FALSE, FALSE, sizeof(struct dir_span));
+	while (p < end) {
+		if (!next_record(&p, end, &record))
+			goto fail;
+
+		if (*record.start == ER_DIR || *record.start == ER_INCOMPLETE) {
+			dir.header = record;
+			dir.files = g_array_new(FALSE, FALSE, sizeof(struct span));
+			dir.block_len = record.len;
+			dirs = g_array_append_val(dirs, dir);
+			current = &g_array_index(dirs, struct dir_span, dirs->len - 1);
+		}
+		else if (*record.start == ER_FILE && current) {
+			current->files = g_array_append_val(current->files, record);
+			current->block_len += record.len;
+		}
+		else
+			goto fail;
+	}
+
+	return dirs;
+
+fail:
+	free_index(dirs);
+	return NULL;
+}
+
+
+static void free_index(GArray* dirs) {
+	guint i;
+
+	if (dirs) {
+		for (i = 0; i < dirs->len; i++)
+			g_array_free(g_array_index(dirs, struct dir_span, i).files, TRUE);
+		g_array_free(dirs, TRUE);
+	}
+}
+
+
+/* Measure the ER_DIR, ER_INCOMPLETE or ER_FILE record at *p and move past
+   it. */
+static gboolean next_record(const gchar** p, const gchar* end,
+		struct span* record) {
+	switch (**p) {
+		case ER_DIR:
+		case ER_INCOMPLETE:
+			return measure(p, end, 1 + 3 * sizeof(guint32), record);
+		case ER_FILE:
+			return measure(p, end, 1 + 2, record);
+		default:
+			return FALSE;
+	}
+}
+
+
+/* Measure a record made of fixed bytes followed by a name. */
+static gboolean measure(const gchar** p, const gchar* end, gsize fixed,
+		struct span* record) {
+	guint16 name_len;
+
+	if (end - *p < fixed + sizeof(name_len))
+		return FALSE;
+	memcpy(&name_len, *p + fixed, sizeof(name_len));
+	name_len = g_ntohs(name_len);
+
+	record->start = *p;
+	record->name = *p + fixed + sizeof(name_len);
+	record->len = fixed + sizeof(name_len) + name_len + 1;
+	if (end - *p < record->len || record->name[name_len] != '\0')
+		return FALSE;
+
+	*p += record->len;
+	return TRUE;
+}
+
+
+static void append_u32(GString* out, guint32 n) {
+	n = g_htonl(n);
+	out = g_string_append_len(out, (gchar*) &n, sizeof(n));
+}
+
+
+static gboolean read_u32(const gchar** p, const gchar* end, guint32* n) {
+	if (end - *p < sizeof(*n))
+		return FALSE;
+	memcpy(n, *p, sizeof(*n));
+	*n = g_ntohl(*n);
+	*p += sizeof(*n);
+	return TRUE;
+}
+
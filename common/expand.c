@@ -0,0 +1,2172 @@
+/*
+	Copyright (C) 2004, 2005 Stephen Bach
+	This file is part of the Viewglob package.
+
+	Viewglob is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Viewglob is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Viewglob; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* The expansion engine.  This used to be all of vgexpand; now vgexpand is
+   just a command line wrapper around it, and vgseer calls it directly, so
+   nothing gets forked per keystroke.  The arguments are either the words
+   of the command line, which are globbed here against the cached listings,
+   or (for what glob-match.c can't handle) the sandbox shell's expansion of
+   them.  Since vgseer's stderr is the user's terminal, nothing in
+   here should complain through g_warning(). */
+
+#include "config.h"
+
+#include "common.h"
+#include "expand.h"
+#include "glob-match.h"
+#include "stat-ring.h"
+#include <sys/stat.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pwd.h>
+#include <fcntl.h>
+
+#if HAVE_SYS_INOTIFY_H
+#  include <sys/inotify.h>
+#  define WATCH_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+		IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
+
+#if HAVE_DIRENT_H
+#  include <dirent.h>
+#  define NAMLEN(dirent) strlen((dirent)->d_name)
+#else
+#  define dirent direct
+#  define NAMLEN(dirent) (dirent)->d_namlen
+#  if HAVE_SYS_NDIR_H
+#   include <sys/ndir.h>
+#  endif
+#  if HAVE_SYS_DIR_H
+#   include <sys/dir.h>
+#  endif
+#  if HAVE_NDIR_H
+#   include <ndir.h>
+#  endif
+#endif
+
+struct listing;
+
+static gboolean do_expand(GString* report_str, const gchar* pwd_name,
+		const gchar* mask, gint argc, gchar** argv, gboolean glob);
+static void  compile_data(gint argc, gchar** argv);
+static GPtrArray* glob_words(gint argc, gchar** argv);
+static void  glob_path(GPtrArray* out, const gchar* word);
+static void  glob_dir(GPtrArray* out, const gchar* prefix,
+		const GlobPattern* gp, gboolean dirs_only);
+static gchar* expand_tilde(const gchar* word);
+static gchar* full_path(const gchar* path);
+static void  mask_match(void);
+static void  report(GString* out);
+static void  print_dir(GString* out, Directory* dir);
+static void  append_name(GString* out, const gchar* prefix, const gchar* name);
+static void  append_u32(GString* out, guint32 n);
+static void  initiate(const struct stat* pwd_stat);
+static void  correlate(gchar* dir_name, gchar* file_name,
+		const struct stat* dir_stat);
+static void  compile_mask(const gchar* mask);
+static struct mask** split(gchar* mask);
+static void  free_masks(struct mask** masks);
+static void  free_dirs(Directory* head);
+
+static Directory* reverse_list(Directory* head);
+
+static gchar*   vg_dirname(const gchar* path);
+static gchar*   vg_basename(const gchar* path);
+static gchar*   normalize_path(const gchar* path, gboolean remove_trailing);
+static gboolean has_trailing_slash(const gchar* path);
+static gint     find_prev(const gchar* string, gint pos, gchar c);
+
+static FileType  determine_type(mode_t mode);
+static FileType  dirent_type(const struct dirent* entry);
+static FileType  stat_type(DIR* dirp, const gchar* dir_name,
+		const gchar* name);
+static void      stat_files(DIR* dirp, const gchar* dir_name, GPtrArray* files);
+static File*           make_new_file(struct listing* listing,
+		const gchar* name, FileType type);
+static Directory*      make_new_dir(gchar* dir_name,
+		const struct stat* dir_stat);
+static gboolean        have_dir(gchar* name, dev_t dev_id, ino_t inode,
+		Directory** return_dir);
+
+static void     mark_prefix(Directory* dir, const gchar* file_name);
+static gboolean index_traverse(gpointer key, gpointer value, gpointer data);
+static gboolean mask_traverse(gpointer key, gpointer value, gpointer data);
+static gboolean print_traverse(gpointer key, gpointer value, gpointer data);
+static gboolean reset_traverse(gpointer key, gpointer value, gpointer data);
+static gboolean copy_traverse(gpointer key, gpointer value, gpointer data);
+static gboolean glob_traverse(gpointer key, gpointer value, gpointer data);
+
+/* Directory listings are cached between expansions. */
+static struct listing* get_listing(const gchar* dir_name,
+		const struct stat* dir_stat);
+static struct listing* scan_listing(const gchar* dir_name,
+		const struct stat* dir_stat);
+static struct listing* new_listing(const gchar* dir_name,
+		const struct stat* dir_stat);
+static void     read_listing(struct listing* listing);
+static void     read_listings(GPtrArray* unread);
+static gboolean listing_ready(struct listing* listing);
+static void     prefetch_listings(GPtrArray* dir_names);
+static void     prefetch_args(gint argc, gchar** argv);
+static gboolean start_scanners(void);
+static void     scanner(gpointer data, gpointer user_data);
+static GPtrArray* listing_by_name(struct listing* listing);
+static gboolean listing_is_fresh(const struct listing* l,
+		const struct stat* dir_stat);
+static void     free_listing(gpointer data);
+static void     destroy_listing(struct listing* listing);
+static void     free_arena(struct listing* listing);
+#if HAVE_SYS_INOTIFY_H
+static void     compact_listing(struct listing* listing);
+#endif
+static void     flush_listings(void);
+static void     cull_listings(void);
+static gboolean stale_traverse(gpointer key, gpointer value, gpointer data);
+static gint     cmp_listing(gconstpointer a, gconstpointer b);
+
+/* Listings are kept current with inotify where it's available. */
+static void     watch_init(void);
+static void     watch_listing(struct listing* listing);
+static void     unwatch_listing(struct listing* listing);
+#if HAVE_SYS_INOTIFY_H
+static void     update_listing(struct listing* listing, const gchar* name,
+		guint32 event_mask);
+#endif
+static gint     cmp_wd(gconstpointer a, gconstpointer b);
+
+/* Directory comparisons are done by inode and device id. */
+static gboolean compare_by_inode(dev_t dev_id1, ino_t inode1, dev_t dev_id2,
+		ino_t inode2);
+
+/* File comparison functions */
+static gint cmp_ls(gconstpointer a, gconstpointer b);
+static gint cmp_win(gconstpointer a, gconstpointer b);
+static gint cmp_by_name(gconstpointer a, gconstpointer b);
+
+/* A snapshot of a directory's contents, kept across expansions so an
+   unchanged directory costs one stat() (which the caller has already done)
+   instead of an opendir() and an lstat() per entry.  The File records are
+   shared with the Directory using the listing, so their selection state is
+   reset each time the listing is handed out.
+
+   The listing is trusted as long as the directory's mtime and ctime are the
+   same as when it was scanned.  A directory modified within the second it
+   was scanned could change again without the mtime moving, so such a
+   listing is never trusted.  Note that changes to the entries themselves
+   (e.g. chmod +x) don't touch the directory, so they can go unnoticed until
+   the directory is otherwise modified.
+
+   If the directory is being watched with inotify, none of that matters:
+   the listing is patched as events come in and is always trusted.
+
+   by_name holds the same files in strcmp() order, so the names starting
+   with a given prefix are together and can be found with a binary search.
+   It's built when first needed and dropped whenever the files change.
+
+   The File records come out of blocks of FILE_BLOCK, and their names are
+   packed into a GStringChunk, so reading a directory takes a handful of
+   allocations and dropping it a handful of frees.  Records of deleted
+   files aren't reused; once they outnumber the live ones, the live ones
+   are copied into a fresh arena.
+
+   A listing being read by a scanner thread belongs to that thread until
+   its state goes back to LS_DONE, which is only changed under scan_mutex.
+   Until then an expansion shows the directory as incomplete. */
+enum listing_state {
+	LS_DONE,
+	LS_READING,          /* Being read, and the expansion is waiting. */
+	LS_LATE,             /* Being read, but the expansion gave up on it. */
+	LS_ORPHANED,         /* Being read, but dropped from the cache. */
+};
+
+struct listing {
+	gchar* name;         /* Path the directory was read through. */
+	dev_t dev_id;
+	ino_t inode;
+	gint wd;             /* inotify watch descriptor, or -1. */
+	time_t mtime;
+	time_t ctime;
+	time_t scanned;      /* When the directory was read. */
+	gint file_count;
+	GTree* files;
+	GPtrArray* by_name;
+	guint last_used;     /* Value of expansion_count when last used. */
+
+	GSList* blocks;      /* File[FILE_BLOCK] each, newest first. */
+	gint block_used;     /* Records handed out from the newest block. */
+	GStringChunk* names;
+	gint dead;           /* Records orphaned by deletions. */
+
+	enum listing_state state;
+	gboolean stale;      /* Changed while it was being read. */
+};
+
+#define FILE_BLOCK 256
+#define NAME_CHUNK 4096
+
+/* Threads reading directories for prefetch_listings(). */
+#define SCANNER_THREADS 8
+static GThreadPool* scanners = NULL;
+static GMutex* scan_mutex = NULL;
+static GCond* scans_done = NULL;
+
+/* The time an expansion may spend waiting on directories (in ms, 0 for no
+   limit), and when the one in progress has to be done by.  A byte is
+   written to late_pipe whenever a read which missed the deadline
+   finishes. */
+static guint budget = 0;
+static GTimeVal deadline;
+static gint late_pipe[2] = { -1, -1 };
+
+/* Don't hold on to more than this many listings not used by the most
+   recent expansion. */
+#define LISTING_CACHE_MAX 64
+
+static GTree* listings = NULL;
+static guint expansion_count = 0;
+
+/* The inotify instance and its watch descriptors, mapped to listings. */
+static gint inotify_fd = -1;
+static GTree* watches = NULL;
+
+/* Order in which to list the directories. */
+static enum sort_order ordering = SO_DESCENDING;
+
+/* Filename sorting */
+static GCompareFunc filename_cmp = cmp_ls;
+
+/* Output format. */
+static enum expand_format format = EF_TEXT;
+
+/* State for the expansion in progress. */
+static const gchar* pwd;
+static size_t pwd_length;
+static gchar* home;
+static size_t home_length;
+
+static Directory* dirs = NULL;
+
+/* The mask, compiled into a single matcher.  It's kept from one expansion to
+   the next (along with the DFA states built so far) until the mask changes.
+   Which of its patterns matched a file comes back as these flags. */
+#define MASK_ANY  (1 << 0)
+#define MASK_DIRS (1 << 1)    /* The pattern had a trailing '/'. */
+static GlobSet* mask_set = NULL;
+static gchar* mask_string = NULL;
+
+/* What glob_traverse() is matching against. */
+struct glob_state {
+	GPtrArray* matches;
+	const GlobPattern* gp;
+	const gchar* prefix;
+	const gchar* dir_name;
+	gboolean dirs_only;
+};
+
+
+/* Interpret vgexpand's ordering and sorting options.  These are passed
+   around as a single string (e.g. "-d -w"), so pick out the letters. */
+void expand_set_opts(const gchar* opts) {
+
+	g_return_if_fail(opts != NULL);
+
+	GCompareFunc prev_cmp = filename_cmp;
+
+	for (; *opts != '\0'; opts++) {
+		switch (*opts) {
+			case 'd':
+				ordering = SO_DESCENDING;
+				break;
+			case 'a':
+				ordering = SO_ASCENDING;
+				break;
+			case 'p':
+				ordering = SO_ASCENDING_PWD_FIRST;
+				break;
+			case 'w':
+				filename_cmp = cmp_win;
+				break;
+			case 'l':
+				filename_cmp = cmp_ls;
+				break;
+			default:
+				/* Skip the dashes and whitespace. */
+				break;
+		}
+	}
+
+	/* Cached listings are sorted by the old function. */
+	if (filename_cmp != prev_cmp)
+		flush_listings();
+}
+
+
+void expand_set_format(enum expand_format f) {
+	format = f;
+}
+
+
+/* Give each expansion at most msec milliseconds to wait on directories (0
+   for no limit).  The directories not read by then are reported as
+   incomplete, and expand_pending_fd() becomes readable once they have
+   been. */
+void expand_set_budget(guint msec) {
+	budget = msec;
+}
+
+
+/* Expand the given (already shell-expanded) arguments against pwd and mask,
+   and append the result to report. */
+gboolean expand(GString* report_str, const gchar* pwd_name, const gchar* mask,
+		gint argc, gchar** argv) {
+	return do_expand(report_str, pwd_name, mask, argc, argv, FALSE);
+}
+
+
+/* As expand(), but the arguments are words from glob_split(), which are
+   brace, tilde and pathname expanded here first. */
+gboolean expand_words(GString* report_str, const gchar* pwd_name,
+		const gchar* mask, gint argc, gchar** argv) {
+	return do_expand(report_str, pwd_name, mask, argc, argv, TRUE);
+}
+
+
+static gboolean do_expand(GString* report_str, const gchar* pwd_name,
+		const gchar* mask, gint argc, gchar** argv, gboolean glob) {
+
+	g_return_val_if_fail(report_str != NULL, FALSE);
+	g_return_val_if_fail(pwd_name != NULL, FALSE);
+	g_return_val_if_fail(mask != NULL, FALSE);
+
+	struct stat dir_stat;
+
+	/* Always expand on pwd, whether it appears in the arguments or not. */
+	if (stat(pwd_name, &dir_stat) != 0)
+		return FALSE;
+
+	pwd = pwd_name;
+	pwd_length = strlen(pwd);
+	home = normalize_path(getenv("HOME"), TRUE);
+	home_length = home ? strlen(home) : 0;
+
+	if (!mask_string || !STREQ(mask_string, mask))
+		compile_mask(mask);
+
+	expansion_count++;
+	if (budget > 0) {
+		g_get_current_time(&deadline);
+		g_time_val_add(&deadline, (glong) budget * 1000);
+	}
+	watch_init();
+
+	/* Bring the watched listings up to date.  A queue overflow flushes
+	   them all, so the cache is only made after this. */
+	(void) expand_process_events();
+	if (!listings)
+		listings = g_tree_new_full((GCompareDataFunc) cmp_listing, NULL,
+				NULL, free_listing);
+
+	initiate(&dir_stat);
+	if (glob) {
+		GPtrArray* args = glob_words(argc, argv);
+		compile_data(args->len, (gchar**) args->pdata);
+		g_ptr_array_foreach(args, (GFunc) g_free, NULL);
+		g_ptr_array_free(args, TRUE);
+	}
+	else
+		compile_data(argc, argv);
+	mask_match();
+	report(report_str);
+
+	cull_listings();
+	free_dirs(dirs);
+	dirs = NULL;
+	g_free(home);
+	home = NULL;
+	pwd = NULL;
+
+	return TRUE;
+}
+
+
+static void compile_data(gint argc, gchar** argv) {
+	gchar* new_dir_name;
+	gchar* new_file_name;
+	gchar* normal_path;
+	gint i;
+
+	struct stat dir_stat;
+
+	prefetch_args(argc, argv);
+
+	/* Loop through the arguments.
+	   The first word is skipped, because that's the name of the command.
+	   We do this here rather than just not passing it from seer, because the
+	   command line could be of the form "{abc,def} ghi", which expands here
+	   to "abc def ghi", so "abc" is the command name rather than "{abc,def}".
+	 */
+	for (i = 1; i < argc && argv[i] != NULL; i++) {
+
+		/* An empty word can't name anything. */
+		if (*argv[i] == '\0')
+			continue;
+
+		normal_path = normalize_path(argv[i], TRUE);
+		new_dir_name = vg_dirname(normal_path);
+		new_file_name = vg_basename(normal_path);
+
+		if (stat(new_dir_name, &dir_stat) == 0) {
+			correlate(new_dir_name, new_file_name, &dir_stat);
+		}
+		else
+			g_free(new_dir_name);
+
+		/* When the filename is used, a copy is made from the dirent entry. */
+		g_free(new_file_name);
+
+		/* normal_path is never saved. */
+		g_free(normal_path);
+
+		if (has_trailing_slash(argv[i])) {
+			/* The file argument is being referenced as a directory.  We've
+			   already dealt with it as a file, so now lets also see if it's a
+			   directory, and if so we'll print its contents too. */
+			normal_path = normalize_path(argv[i], FALSE);
+			new_dir_name = vg_dirname(normal_path);
+
+			if (stat(new_dir_name, &dir_stat) == 0)
+				correlate(new_dir_name, NULL, &dir_stat);
+			else
+				g_free(new_dir_name);
+
+			g_free(normal_path);
+		}
+	}
+}
+
+
+/* Do what the shell would do to the words before handing them to a command,
+   short of the things sanitize() has already removed. */
+static GPtrArray* glob_words(gint argc, gchar** argv) {
+	GPtrArray* expanded = g_ptr_array_new();
+	GPtrArray* braced = g_ptr_array_new();
+	gchar* word;
+	gint i, j;
+
+	for (i = 0; i < argc && argv[i] != NULL; i++) {
+		g_ptr_array_set_size(braced, 0);
+		glob_braces(braced, argv[i]);
+
+		for (j = 0; j < braced->len; j++) {
+			word = expand_tilde(g_ptr_array_index(braced, j));
+			glob_path(expanded, word);
+			g_free(word);
+			g_free(g_ptr_array_index(braced, j));
+		}
+	}
+
+	g_ptr_array_free(braced, TRUE);
+	return expanded;
+}
+
+
+/* Pathname expansion of a single word.  Components with no magic are taken
+   as they are, except that after a glob they have to exist; the others are
+   matched against the listing of each directory reached so far.  If nothing
+   matches, the word stays as it is (bash's default, and zsh's with
+   NO_NOMATCH, which the sandbox sets). */
+static void glob_path(GPtrArray* out, const gchar* word) {
+	GPtrArray* paths;
+	GPtrArray* next;
+	GlobPattern* gp;
+	const gchar* comp;
+	const gchar* slash;
+	gchar* literal;
+	gchar* path;
+	gchar* full;
+	gboolean magic = FALSE;
+	struct stat st;
+	gsize len;
+	gint i;
+
+	paths = g_ptr_array_new();
+	g_ptr_array_add(paths, g_strdup(*word == '/' ? "/" : ""));
+
+	for (comp = word; *comp == '/'; comp++)
+		;
+
+	while (*comp != '\0' && paths->len > 0) {
+		slash = strchr(comp, '/');
+		len = slash ? slash - comp : strlen(comp);
+		next = g_ptr_array_new();
+
+		if (glob_has_magic(comp, len)) {
+			magic = TRUE;
+			if (paths->len > 1) {
+				GPtrArray* dir_names = g_ptr_array_new();
+				for (i = 0; i < paths->len; i++) {
+					g_ptr_array_add(dir_names,
+							full_path(g_ptr_array_index(paths, i)));
+				}
+				prefetch_listings(dir_names);
+				g_ptr_array_foreach(dir_names, (GFunc) g_free, NULL);
+				g_ptr_array_free(dir_names, TRUE);
+			}
+			gp = glob_compile(comp, len);
+			for (i = 0; i < paths->len; i++) {
+				glob_dir(next, g_ptr_array_index(paths, i), gp,
+						slash != NULL);
+			}
+			glob_free(gp);
+		}
+		else {
+			literal = glob_unescape(comp, len);
+			for (i = 0; i < paths->len; i++) {
+				path = g_strconcat(g_ptr_array_index(paths, i), literal,
+						slash ? "/" : "", NULL);
+				full = full_path(path);
+				if (!magic || (stat(full, &st) == 0 &&
+							(!slash || S_ISDIR(st.st_mode))))
+					g_ptr_array_add(next, path);
+				else
+					g_free(path);
+				g_free(full);
+			}
+			g_free(literal);
+		}
+
+		g_ptr_array_foreach(paths, (GFunc) g_free, NULL);
+		g_ptr_array_free(paths, TRUE);
+		paths = next;
+
+		if (!slash)
+			break;
+		for (comp = slash; *comp == '/'; comp++)
+			;
+	}
+
+	if (magic && paths->len > 0) {
+		for (i = 0; i < paths->len; i++)
+			g_ptr_array_add(out, g_ptr_array_index(paths, i));
+	}
+	else {
+		g_ptr_array_add(out, glob_unescape(word, strlen(word)));
+		g_ptr_array_foreach(paths, (GFunc) g_free, NULL);
+	}
+	g_ptr_array_free(paths, TRUE);
+}
+
+
+/* Add the entries of the directory at prefix which match gp. */
+static void glob_dir(GPtrArray* out, const gchar* prefix,
+		const GlobPattern* gp, gboolean dirs_only) {
+	struct glob_state state;
+	struct listing* listing;
+	struct stat dir_stat;
+	gchar* dir_name;
+
+	dir_name = full_path(prefix);
+	if (stat(dir_name, &dir_stat) == 0 && S_ISDIR(dir_stat.st_mode)) {
+		listing = get_listing(dir_name, &dir_stat);
+		if (listing_ready(listing) && listing->files) {
+			state.matches = out;
+			state.gp = gp;
+			state.prefix = prefix;
+			state.dir_name = dir_name;
+			state.dirs_only = dirs_only;
+			g_tree_foreach(listing->files, glob_traverse, &state);
+		}
+	}
+	g_free(dir_name);
+}
+
+
+static gboolean glob_traverse(gpointer key, gpointer value, gpointer data) {
+	File* file = key;
+	struct glob_state* state = data;
+	struct stat st;
+	gchar* target;
+	gboolean is_dir;
+
+	if (STREQ(file->name, ".") || STREQ(file->name, ".."))
+		return FALSE;
+	if (!glob_match(state->gp, file->name))
+		return FALSE;
+
+	if (state->dirs_only && file->type != FT_DIRECTORY) {
+		if (file->type != FT_SYMLINK)
+			return FALSE;
+		target = g_strconcat(state->dir_name, "/", file->name, NULL);
+		is_dir = stat(target, &st) == 0 && S_ISDIR(st.st_mode);
+		g_free(target);
+		if (!is_dir)
+			return FALSE;
+	}
+
+	g_ptr_array_add(state->matches, g_strconcat(state->prefix, file->name,
+				state->dirs_only ? "/" : "", NULL));
+	return FALSE;
+}
+
+
+/* Replace a leading unquoted "~" or "~user" with the home directory, quoted
+   so it won't be taken as a pattern. */
+static gchar* expand_tilde(const gchar* word) {
+	const gchar* name_end;
+	const gchar* dir = NULL;
+	struct passwd* pw;
+	gchar* user;
+	GString* expanded;
+
+	if (*word != '~')
+		return g_strdup(word);
+
+	name_end = strchr(word, '/');
+	if (!name_end)
+		name_end = word + strlen(word);
+
+	if (name_end == word + 1) {
+		dir = home;
+		if (!dir && (pw = getpwuid(getuid())) != NULL)
+			dir = pw->pw_dir;
+	}
+	else if (!memchr(word, '\\', name_end - word)) {
+		user = g_strndup(word + 1, name_end - word - 1);
+		if ( (pw = getpwnam(user)) != NULL)
+			dir = pw->pw_dir;
+		g_free(user);
+	}
+
+	if (!dir)
+		return g_strdup(word);
+
+	expanded = g_string_new(NULL);
+	for (; *dir != '\0'; dir++) {
+		if (*dir != '/')
+			expanded = g_string_append_c(expanded, '\\');
+		expanded = g_string_append_c(expanded, *dir);
+	}
+	expanded = g_string_append(expanded, name_end);
+	return g_string_free(expanded, FALSE);
+}
+
+
+/* Where a path from the command line really is, given it's relative to the
+   user's pwd rather than ours. */
+static gchar* full_path(const gchar* path) {
+	if (*path == '/')
+		return g_strdup(path);
+	else if (*path == '\0')
+		return g_strdup(pwd);
+	else
+		return g_strconcat(pwd, "/", path, NULL);
+}
+
+
+/* Prefetch the directories compile_data() is going to look at. */
+static void prefetch_args(gint argc, gchar** argv) {
+	GPtrArray* dir_names = g_ptr_array_new();
+	gchar* normal_path;
+	gint i;
+
+	for (i = 1; i < argc && argv[i] != NULL; i++) {
+		if (*argv[i] == '\0')
+			continue;
+
+		normal_path = normalize_path(argv[i], TRUE);
+		g_ptr_array_add(dir_names, vg_dirname(normal_path));
+		g_free(normal_path);
+
+		if (has_trailing_slash(argv[i])) {
+			normal_path = normalize_path(argv[i], FALSE);
+			g_ptr_array_add(dir_names, vg_dirname(normal_path));
+			g_free(normal_path);
+		}
+	}
+
+	prefetch_listings(dir_names);
+
+	g_ptr_array_foreach(dir_names, (GFunc) g_free, NULL);
+	g_ptr_array_free(dir_names, TRUE);
+}
+
+
+static void mask_match(void) {
+	Directory* dir_iter;
+
+	for (dir_iter = dirs; dir_iter; dir_iter = dir_iter->next_dir) {
+		if (dir_iter->files)
+			g_tree_foreach(dir_iter->files, mask_traverse, dir_iter);
+	}
+}
+
+
+static gboolean has_trailing_slash(const gchar* path) {
+	gint i;
+
+	for (i = 0; *(path + i) != '\0'; i++)
+		;
+
+	if (i) {
+		i--;
+		return *(path + i) == '/';
+	}
+	else
+		return FALSE;
+}
+
+
+static void report(GString* out) {
+	Directory* dir_iter;
+	Directory* pwd_dir = NULL;
+
+	if (format == EF_BINARY)
+		out = g_string_append_c(out, EXPAND_DATA_MAGIC);
+
+	switch (ordering) {
+
+		case SO_ASCENDING:
+			dirs = reverse_list(dirs);
+			break;
+
+		case SO_ASCENDING_PWD_FIRST:
+			/* Print off the first dir in the list and then set it aside
+			   until the rest have been reversed. */
+			if (dirs) {
+				print_dir(out, dirs);
+				pwd_dir = dirs;
+				dirs = dirs->next_dir;
+				pwd_dir->next_dir = NULL;
+				dirs = reverse_list(dirs);
+			}
+			break;
+
+		case SO_DESCENDING:
+		default:
+			break;
+	}
+
+	for (dir_iter = dirs; dir_iter; dir_iter = dir_iter->next_dir)
+		print_dir(out, dir_iter);
+
+	/* Put pwd back so it gets freed with the rest. */
+	if (pwd_dir) {
+		pwd_dir->next_dir = dirs;
+		dirs = pwd_dir;
+	}
+
+	if (format == EF_TEXT)
+		out = g_string_append_c(out, '\n');
+}
+
+
+static void print_dir(GString* out, Directory* dir) {
+	gchar* name;
+	size_t name_len;
+	gchar prefix[3];
+	gint i = 0;
+
+	if (dir) {
+		if (dir->is_pwd)
+			prefix[i++] = PWD_CHAR;  /* Differentiate PWD. */
+
+		/* Convert the "/home/blah" prefix to "~".  Need to be careful here
+		   because /home/blahblah/ shouldn't become ~blah/ */
+		name = dir->name;
+		name_len = strlen(name);
+		if (home && home_length <= name_len &&
+				strncmp(home, name, home_length) == 0 &&
+				(name[home_length] == '\0' || name[home_length] == '/')) {
+			prefix[i++] = '~';
+			name += home_length;
+		}
+		prefix[i] = '\0';
+
+		if (format == EF_BINARY) {
+			out = g_string_append_c(out,
+					dir->incomplete ? ER_INCOMPLETE : ER_DIR);
+			append_u32(out, dir->selected_count);
+			append_u32(out, dir->file_count);
+			append_u32(out, dir->hidden_count);
+			append_name(out, prefix, name);
+		}
+		else if (dir->incomplete) {
+			g_string_append_printf(out, "%s %s %s %s%s\n",
+					EXPAND_INCOMPLETE_COUNT,
+					EXPAND_INCOMPLETE_COUNT,
+					EXPAND_INCOMPLETE_COUNT,
+					prefix, name);
+		}
+		else {
+			g_string_append_printf(out, "%d %d %d %s%s\n",
+					dir->selected_count,
+					dir->file_count,
+					dir->hidden_count,
+					prefix, name);
+		}
+
+		if (dir->files)
+			g_tree_foreach(dir->files, print_traverse, out);
+	}
+}
+
+
+static Directory* reverse_list(Directory* head) {
+	Directory* p1 = NULL;
+	Directory* p2;
+
+	if (head) {
+		p1 = head;
+		p2 = head->next_dir;
+		p1->next_dir = NULL;
+
+		while(p2) {
+			Directory *q = p2->next_dir;
+			p2->next_dir = p1;
+			p1 = p2;
+			p2 = q;
+		}
+	}
+
+	return p1;
+}
+
+
+static gboolean print_traverse(gpointer key, gpointer value, gpointer data) {
+
+	static const gchar types[FT_COUNT] = {
+		/*FT_REGULAR*/    'r',
+		/*FT_EXECUTABLE*/ 'e',
+		/*FT_DIRECTORY*/  'd',
+		/*FT_BLOCKDEV*/   'b',
+		/*FT_CHARDEV*/    'c',
+		/*FT_FIFO*/       'f',
+		/*FT_SOCKET*/     's',
+		/*FT_SYMLINK*/    'y',
+	};
+
+	static const gchar selections[FS_COUNT] = {
+		/*FS_YES*/    '*',
+		/*FS_NO*/     '-',
+		/*FS_MAYBE*/  '~',
+	};
+
+	File* file = key;
+	GString* out = data;
+
+	if (!file->shown)
+		return FALSE;
+
+	if (format == EF_BINARY) {
+		out = g_string_append_c(out, ER_FILE);
+		out = g_string_append_c(out, file->selected);
+		out = g_string_append_c(out, file->type);
+		append_name(out, "", file->name);
+	}
+	else {
+		g_string_append_printf(out, "\t%c %c %s\n",
+				selections[file->selected],
+				types[file->type],
+				file->name);
+	}
+
+	return FALSE;
+}
+
+
+/* Append a binary format name: length, name and NUL. */
+static void append_name(GString* out, const gchar* prefix, const gchar* name) {
+	gsize prefix_len = strlen(prefix);
+	gsize name_len = strlen(name);
+	guint16 len;
+
+	len = g_htons(MIN(prefix_len + name_len, G_MAXUINT16));
+	out = g_string_append_len(out, (gchar*) &len, sizeof(len));
+	out = g_string_append_len(out, prefix, prefix_len);
+	out = g_string_append_len(out, name,
+			MIN(name_len, G_MAXUINT16 - prefix_len));
+	out = g_string_append_c(out, '\0');
+}
+
+
+static void append_u32(GString* out, guint32 n) {
+	n = g_htonl(n);
+	out = g_string_append_len(out, (gchar*) &n, sizeof(n));
+}
+
+
+/* Scan through pwd. */
+static void initiate(const struct stat* pwd_stat) {
+	dirs = make_new_dir(g_strdup(pwd), pwd_stat);
+	dirs->is_pwd = TRUE;
+}
+
+
+/* Fit this new directory and file into the others that have been processed,
+   if possible. */
+static void correlate(gchar* dir_name, gchar* file_name,
+		const struct stat* dir_stat) {
+	Directory* search_dir;
+
+	if (have_dir(dir_name, dir_stat->st_dev, dir_stat->st_ino,
+				&search_dir)) {
+		/* In this case search_dir is the located directory.
+		   Since the dir is already known, we don't need this. */
+		g_free(dir_name);
+	}
+	else {
+		/* In this case search_dir is the last directory struct in the list,
+		   so add this new dir to the end. */
+		search_dir->next_dir = make_new_dir(dir_name, dir_stat);
+		search_dir = search_dir->next_dir;
+	}
+
+	if (file_name && search_dir->by_name)
+		mark_prefix(search_dir, file_name);
+}
+
+
+/* Check out if we've already got this directory in dirs.
+   If so, return it.  If not, return the last dir in the dir_list. */
+static gboolean have_dir(gchar* name, dev_t dev_id, ino_t inode,
+		Directory** return_dir) {
+	Directory* dir_iter;
+
+	dir_iter = dirs;
+	do {
+		if (compare_by_inode(dev_id, inode, dir_iter->dev_id,
+					dir_iter->inode)) {
+			*return_dir = dir_iter;
+			return TRUE;
+		}
+	} while ((dir_iter->next_dir != NULL) && (dir_iter = dir_iter->next_dir));
+	/* ^^ Don't want to iterate to NULL, thus the weird invariant. */
+
+	/* This is the last directory struct in the list. */
+	*return_dir = dir_iter;
+	return FALSE;
+}
+
+
+static gboolean compare_by_inode(dev_t dev_id1, ino_t inode1, dev_t dev_id2,
+		ino_t inode2) {
+	return inode1 == inode2 && dev_id1 == dev_id2;
+}
+
+
+static gboolean mask_traverse(gpointer key, gpointer value, gpointer data) {
+	File* file = key;
+	Directory* dir = data;
+
+	guint matched;
+
+	if (file->selected != FS_YES) {
+		matched = glob_set_match(mask_set, file->name);
+		if ( (matched & MASK_ANY) ||
+				((matched & MASK_DIRS) && file->type == FT_DIRECTORY)) {
+			file->shown = TRUE;
+			dir->hidden_count--;
+		}
+	}
+
+	return FALSE;
+}
+
+
+/* Mark the files whose names start with file_name: an exact match is
+   selected, the rest are partial matches.  They're all together in by_name,
+   starting at the first name not less than file_name. */
+static void mark_prefix(Directory* dir, const gchar* file_name) {
+	GPtrArray* by_name = dir->by_name;
+	size_t len = strlen(file_name);
+	guint lo = 0, hi = by_name->len, mid;
+	File* file;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		file = g_ptr_array_index(by_name, mid);
+		if (strcmp(file->name, file_name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < by_name->len; lo++) {
+		file = g_ptr_array_index(by_name, lo);
+
+		if (!STRNEQ(file_name, file->name, len))
+			break;
+
+		/* Don't bother with the file if it's already selected. */
+		if (file->selected == FS_YES)
+			continue;
+
+		if (file->name[len] == '\0') {
+			/* Explicit match. */
+			file->selected = FS_YES;
+			file->shown = TRUE;
+			dir->selected_count++;
+			dir->hidden_count--;
+		}
+		else {
+			/* Only a partial match. */
+			file->selected = FS_MAYBE;
+		}
+	}
+}
+
+
+static File* make_new_file(struct listing* listing, const gchar* name,
+		FileType type) {
+	File* new_file;
+
+	if (!listing->blocks || listing->block_used == FILE_BLOCK) {
+		listing->blocks = g_slist_prepend(listing->blocks,
+				g_new(File, FILE_BLOCK));
+		listing->block_used = 0;
+	}
+	if (!listing->names)
+		listing->names = g_string_chunk_new(NAME_CHUNK);
+
+	new_file = (File*) listing->blocks->data + listing->block_used++;
+	new_file->name = g_string_chunk_insert(listing->names, name);
+	new_file->selected = FS_NO;
+	new_file->type = type;
+	new_file->shown = FALSE;
+	return new_file;
+}
+
+
+static Directory* make_new_dir(gchar* dir_name, const struct stat* dir_stat) {
+	Directory* new_dir;
+	struct listing* listing;
+
+	listing = get_listing(dir_name, dir_stat);
+
+	new_dir = g_new(Directory, 1);
+	new_dir->name = dir_name;
+	new_dir->dev_id = dir_stat->st_dev;
+	new_dir->inode = dir_stat->st_ino;
+	new_dir->selected_count = 0;
+	new_dir->is_pwd = FALSE;
+	new_dir->next_dir = NULL;
+
+	if (listing_ready(listing)) {
+		new_dir->incomplete = FALSE;
+		new_dir->files = listing->files;
+		new_dir->by_name = listing_by_name(listing);
+		new_dir->file_count = listing->file_count;
+		new_dir->hidden_count = listing->file_count;
+	}
+	else {
+		/* Still being read; there's nothing to show yet. */
+		new_dir->incomplete = TRUE;
+		new_dir->files = NULL;
+		new_dir->by_name = NULL;
+		new_dir->file_count = 0;
+		new_dir->hidden_count = 0;
+	}
+
+	return new_dir;
+}
+
+
+/* Find the listing for the given directory, reading it if it isn't cached
+   or has changed since it was. */
+static struct listing* get_listing(const gchar* dir_name,
+		const struct stat* dir_stat) {
+	struct listing key;
+	struct listing* listing;
+
+	key.dev_id = dir_stat->st_dev;
+	key.inode = dir_stat->st_ino;
+
+	listing = g_tree_lookup(listings, &key);
+	if (listing && listing->last_used == expansion_count) {
+		/* Already handed out (to the globbing) during this expansion. */
+		return listing;
+	}
+	else if (listing && !listing_ready(listing)) {
+		/* An earlier expansion's read of it still hasn't finished.  It'll
+		   be shown as incomplete. */
+	}
+	else if (listing && listing_is_fresh(listing, dir_stat)) {
+		/* Wipe the last expansion's marks. */
+		if (listing->files)
+			g_tree_foreach(listing->files, reset_traverse, NULL);
+	}
+	else {
+		/* Drop the old listing (and its watch) before setting up the new
+		   one, since inotify would hand back the same watch descriptor. */
+		if (listing)
+			g_tree_remove(listings, listing);
+		listing = scan_listing(dir_name, dir_stat);
+		g_tree_insert(listings, listing, listing);
+	}
+
+	listing->last_used = expansion_count;
+	return listing;
+}
+
+
+static gboolean listing_is_fresh(const struct listing* l,
+		const struct stat* dir_stat) {
+	if (l->stale)
+		return FALSE;
+	if (l->wd != -1)
+		return TRUE;
+	return l->mtime == dir_stat->st_mtime &&
+		l->ctime == dir_stat->st_ctime &&
+		l->mtime < l->scanned;
+}
+
+
+/* The listing's files in strcmp() order.  With ls sorting that's the order
+   they're already in. */
+static GPtrArray* listing_by_name(struct listing* listing) {
+	if (!listing->by_name && listing->files) {
+		listing->by_name = g_ptr_array_sized_new(listing->file_count);
+		g_tree_foreach(listing->files, index_traverse, listing->by_name);
+		if (filename_cmp != cmp_ls)
+			g_ptr_array_sort(listing->by_name, cmp_by_name);
+	}
+	return listing->by_name;
+}
+
+
+/* Read the directory into a new listing. */
+static struct listing* scan_listing(const gchar* dir_name,
+		const struct stat* dir_stat) {
+	struct listing* listing = new_listing(dir_name, dir_stat);
+	GPtrArray* unread = g_ptr_array_new();
+
+	g_ptr_array_add(unread, listing);
+	read_listings(unread);
+	g_ptr_array_free(unread, TRUE);
+	return listing;
+}
+
+
+/* Set up an empty listing for the directory, and start watching it (before
+   it's read, so nothing slips in between). */
+static struct listing* new_listing(const gchar* dir_name,
+		const struct stat* dir_stat) {
+	struct listing* listing;
+
+	listing = g_new(struct listing, 1);
+	listing->name = g_strdup(dir_name);
+	listing->dev_id = dir_stat->st_dev;
+	listing->inode = dir_stat->st_ino;
+	listing->mtime = dir_stat->st_mtime;
+	listing->ctime = dir_stat->st_ctime;
+	listing->scanned = time(NULL);
+	listing->file_count = 0;
+	/* Made here rather than by whoever reads it, since filename_cmp may
+	   change in the meantime. */
+	listing->files = g_tree_new(filename_cmp);
+	listing->by_name = NULL;
+	listing->last_used = 0;
+	listing->blocks = NULL;
+	listing->block_used = 0;
+	listing->names = NULL;
+	listing->dead = 0;
+	listing->state = LS_DONE;
+	listing->stale = FALSE;
+
+	watch_listing(listing);
+	return listing;
+}
+
+
+/* Fill in the listing from the directory.  This only touches the listing
+   itself, so it can be done on a scanner thread. */
+static void read_listing(struct listing* listing) {
+	const gchar* dir_name = listing->name;
+	DIR* dirp;
+	struct dirent* entry;
+	gint entry_count = 0;
+	GPtrArray* unknown;
+	File* file;
+	FileType type;
+	guint i;
+
+	dirp = opendir(dir_name);
+	if (dirp == NULL) {
+		/* Inaccessible, so just list it as empty. */
+		return;
+	}
+
+	/* Cycle through the files in the real directory, and add them to the
+	   listing.  make_new_file() copies the name, since the original data
+	   isn't reliable.  Files whose type d_type doesn't give away are put
+	   aside to be stat'ed together. */
+	unknown = g_ptr_array_new();
+	while (errno = 0, (entry = readdir(dirp)) != NULL) {
+
+		type = dirent_type(entry);
+		file = make_new_file(listing, entry->d_name, type);
+
+		/* The tree may be sorted by type, so these can't go in yet. */
+		if (type == FT_COUNT)
+			g_ptr_array_add(unknown, file);
+		else
+			g_tree_insert(listing->files, file, NULL);
+
+		entry_count++;
+	}
+
+	stat_files(dirp, dir_name, unknown);
+	for (i = 0; i < unknown->len; i++)
+		g_tree_insert(listing->files, g_ptr_array_index(unknown, i), NULL);
+	g_ptr_array_free(unknown, TRUE);
+
+	listing->file_count = entry_count;
+
+#ifdef CLOSEDIR_VOID
+	closedir(dirp);
+#else
+	(void) closedir(dirp);
+#endif
+}
+
+
+/* Make sure the listings of all the given directories are current before
+   the expansion goes looking at them one by one.  The ones that have to be
+   read are read in parallel, so a command line naming a lot of directories
+   on a slow (e.g. NFS) filesystem waits about as long as the slowest of
+   them rather than all of them in turn.  The expansion itself is still
+   done in order afterwards, so the results don't depend on which read
+   finished first. */
+static void prefetch_listings(GPtrArray* dir_names) {
+	struct listing key;
+	struct listing* listing;
+	struct stat dir_stat;
+	GPtrArray* unread;
+	gint i;
+
+	unread = g_ptr_array_new();
+
+	for (i = 0; i < dir_names->len; i++) {
+		if (stat(g_ptr_array_index(dir_names, i), &dir_stat) != 0 ||
+				!S_ISDIR(dir_stat.st_mode))
+			continue;
+
+		key.dev_id = dir_stat.st_dev;
+		key.inode = dir_stat.st_ino;
+		listing = g_tree_lookup(listings, &key);
+
+		if (listing && (listing->last_used == expansion_count ||
+					!listing_ready(listing) ||
+					listing_is_fresh(listing, &dir_stat))) {
+			(void) get_listing(listing->name, &dir_stat);
+			continue;
+		}
+
+		if (listing)
+			g_tree_remove(listings, listing);
+		listing = new_listing(g_ptr_array_index(dir_names, i), &dir_stat);
+		listing->last_used = expansion_count;
+		g_tree_insert(listings, listing, listing);
+		g_ptr_array_add(unread, listing);
+	}
+
+	read_listings(unread);
+	g_ptr_array_free(unread, TRUE);
+}
+
+
+/* Read the given new listings.  They're handed to the scanner threads if
+   there's more than one, or if the expansion has a deadline to meet; in
+   that case the ones which miss it are left to finish in the background
+   (and a byte is written to late_pipe when they do). */
+static void read_listings(GPtrArray* unread) {
+	struct listing* listing;
+	gint i;
+
+	if ((unread->len > 1 || (budget > 0 && unread->len > 0)) &&
+			start_scanners()) {
+		g_mutex_lock(scan_mutex);
+		for (i = 0; i < unread->len; i++) {
+			listing = g_ptr_array_index(unread, i);
+			listing->state = LS_READING;
+			g_thread_pool_push(scanners, listing, NULL);
+		}
+
+		i = 0;
+		while (i < unread->len) {
+			listing = g_ptr_array_index(unread, i);
+			if (listing->state != LS_READING)
+				i++;
+			else if (budget == 0)
+				g_cond_wait(scans_done, scan_mutex);
+			else if (!g_cond_timed_wait(scans_done, scan_mutex, &deadline)) {
+				/* Out of time, so go on without the rest. */
+				for (; i < unread->len; i++) {
+					listing = g_ptr_array_index(unread, i);
+					if (listing->state == LS_READING)
+						listing->state = LS_LATE;
+				}
+			}
+		}
+		g_mutex_unlock(scan_mutex);
+	}
+	else {
+		for (i = 0; i < unread->len; i++)
+			read_listing(g_ptr_array_index(unread, i));
+	}
+}
+
+
+/* Whether the listing can be looked at, i.e. no scanner thread has it. */
+static gboolean listing_ready(struct listing* listing) {
+	gboolean ready;
+
+	if (!scan_mutex)
+		return TRUE;
+
+	g_mutex_lock(scan_mutex);
+	ready = listing->state == LS_DONE;
+	g_mutex_unlock(scan_mutex);
+	return ready;
+}
+
+
+/* Set up the scanner threads, if threads are available. */
+static gboolean start_scanners(void) {
+	gint i;
+
+	if (scanners)
+		return TRUE;
+	if (!g_thread_supported())
+		return FALSE;
+
+	scanners = g_thread_pool_new(scanner, NULL, SCANNER_THREADS, FALSE,
+			NULL);
+	if (!scanners)
+		return FALSE;
+	scan_mutex = g_mutex_new();
+	scans_done = g_cond_new();
+
+	/* Nobody should block on this, and the shells shouldn't inherit it. */
+	if (pipe(late_pipe) == 0) {
+		for (i = 0; i < 2; i++) {
+			(void) fcntl(late_pipe[i], F_SETFL, O_NONBLOCK);
+			(void) fcntl(late_pipe[i], F_SETFD, FD_CLOEXEC);
+		}
+	}
+	else
+		late_pipe[0] = late_pipe[1] = -1;
+
+	return TRUE;
+}
+
+
+static void scanner(gpointer data, gpointer user_data) {
+	struct listing* listing = data;
+	gboolean orphaned;
+
+	read_listing(listing);
+
+	g_mutex_lock(scan_mutex);
+	orphaned = listing->state == LS_ORPHANED;
+	if (listing->state == LS_LATE && late_pipe[1] != -1)
+		(void) write(late_pipe[1], "", 1);
+	listing->state = LS_DONE;
+	g_cond_broadcast(scans_done);
+	g_mutex_unlock(scan_mutex);
+
+	/* It's been dropped from the cache, so no one else will free it. */
+	if (orphaned)
+		destroy_listing(listing);
+}
+
+
+static void free_listing(gpointer data) {
+	struct listing* listing = data;
+
+	unwatch_listing(listing);
+
+	/* A scanner thread still has it; let the thread free it. */
+	if (scan_mutex) {
+		g_mutex_lock(scan_mutex);
+		if (listing->state != LS_DONE) {
+			listing->state = LS_ORPHANED;
+			g_mutex_unlock(scan_mutex);
+			return;
+		}
+		g_mutex_unlock(scan_mutex);
+	}
+
+	destroy_listing(listing);
+}
+
+
+static void destroy_listing(struct listing* listing) {
+	g_free(listing->name);
+	if (listing->by_name)
+		g_ptr_array_free(listing->by_name, TRUE);
+	if (listing->files)
+		g_tree_destroy(listing->files);
+	free_arena(listing);
+	g_free(listing);
+}
+
+
+static void free_arena(struct listing* listing) {
+	GSList* iter;
+
+	for (iter = listing->blocks; iter; iter = g_slist_next(iter))
+		g_free(iter->data);
+	g_slist_free(listing->blocks);
+	listing->blocks = NULL;
+	listing->block_used = 0;
+	if (listing->names) {
+		g_string_chunk_free(listing->names);
+		listing->names = NULL;
+	}
+	listing->dead = 0;
+}
+
+
+static void flush_listings(void) {
+	if (listings) {
+		g_tree_destroy(listings);
+		listings = NULL;
+	}
+}
+
+
+/* Drop listings the last expansion didn't use if there are too many. */
+static void cull_listings(void) {
+	GSList* stale = NULL;
+	GSList* iter;
+
+	if (g_tree_nnodes(listings) <= LISTING_CACHE_MAX)
+		return;
+
+	g_tree_foreach(listings, stale_traverse, &stale);
+	for (iter = stale; iter; iter = g_slist_next(iter))
+		g_tree_remove(listings, iter->data);
+	g_slist_free(stale);
+}
+
+
+static gboolean stale_traverse(gpointer key, gpointer value, gpointer data) {
+	struct listing* listing = value;
+	GSList** stale = data;
+
+	if (listing->last_used != expansion_count)
+		*stale = g_slist_prepend(*stale, listing);
+	return FALSE;
+}
+
+
+static gint cmp_listing(gconstpointer a, gconstpointer b) {
+	const struct listing* aa = a;
+	const struct listing* bb = b;
+
+	if (aa->dev_id != bb->dev_id)
+		return aa->dev_id < bb->dev_id ? -1 : 1;
+	else if (aa->inode != bb->inode)
+		return aa->inode < bb->inode ? -1 : 1;
+	else
+		return 0;
+}
+
+
+/* Get the inotify instance going, if we can. */
+static void watch_init(void) {
+#if HAVE_SYS_INOTIFY_H
+	if (inotify_fd != -1)
+		return;
+
+	inotify_fd = inotify_init();
+	if (inotify_fd == -1)
+		return;
+
+	/* Events are drained without blocking, and the shells shouldn't
+	   inherit the descriptor. */
+	if (fcntl(inotify_fd, F_SETFL, O_NONBLOCK) == -1 ||
+			fcntl(inotify_fd, F_SETFD, FD_CLOEXEC) == -1) {
+		(void) close(inotify_fd);
+		inotify_fd = -1;
+		return;
+	}
+
+	watches = g_tree_new(cmp_wd);
+#endif
+}
+
+
+static void watch_listing(struct listing* listing) {
+	listing->wd = -1;
+#if HAVE_SYS_INOTIFY_H
+	if (inotify_fd == -1)
+		return;
+
+	/* If this fails (e.g. we've run out of watches) the listing just falls
+	   back to being checked against the directory's mtime. */
+	listing->wd = inotify_add_watch(inotify_fd, listing->name, WATCH_EVENTS);
+	if (listing->wd != -1)
+		g_tree_insert(watches, GINT_TO_POINTER(listing->wd), listing);
+#endif
+}
+
+
+static void unwatch_listing(struct listing* listing) {
+#if HAVE_SYS_INOTIFY_H
+	if (listing->wd == -1)
+		return;
+
+	g_tree_remove(watches, GINT_TO_POINTER(listing->wd));
+	(void) inotify_rm_watch(inotify_fd, listing->wd);
+	listing->wd = -1;
+#endif
+}
+
+
+/* Return the inotify descriptor so the caller can wait on it, or -1 if
+   listings aren't being watched. */
+gint expand_watch_fd(void) {
+	return inotify_fd;
+}
+
+
+/* Return a descriptor which becomes readable when a directory an expansion
+   gave up on has finally been read, or -1 if there's no such thing yet. */
+gint expand_pending_fd(void) {
+	return late_pipe[0];
+}
+
+
+/* Apply any pending inotify events to the cached listings, and take note of
+   directories read since an expansion gave up on them.  Returns TRUE if a
+   listing used by the last expansion changed or was finally read, in which
+   case it's out of date. */
+gboolean expand_process_events(void) {
+	gboolean changed = FALSE;
+	gchar drain[64];
+
+	if (late_pipe[0] != -1) {
+		while (read(late_pipe[0], drain, sizeof(drain)) > 0)
+			changed = TRUE;
+	}
+
+#if HAVE_SYS_INOTIFY_H
+	static union {
+		struct inotify_event event;
+		gchar bytes[4096];
+	} buf;
+	struct inotify_event* event;
+	struct listing* listing;
+	gssize nread;
+	gssize pos;
+
+	if (inotify_fd == -1)
+		return changed;
+
+	while ((nread = read(inotify_fd, buf.bytes, sizeof(buf))) > 0) {
+		for (pos = 0; pos < nread;
+				pos += sizeof(struct inotify_event) + event->len) {
+			event = (struct inotify_event*) (buf.bytes + pos);
+
+			if (event->mask & IN_Q_OVERFLOW) {
+				/* Lost track; start over. */
+				flush_listings();
+				changed = TRUE;
+				continue;
+			}
+
+			if (!listings)
+				continue;
+			listing = g_tree_lookup(watches, GINT_TO_POINTER(event->wd));
+			if (!listing)
+				continue;
+
+			if (listing->last_used == expansion_count)
+				changed = TRUE;
+
+			if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED |
+						IN_UNMOUNT)) {
+				/* The directory itself is gone (or elsewhere). */
+				g_tree_remove(listings, listing);
+			}
+			else if (!listing_ready(listing)) {
+				/* There's no telling whether the read saw this. */
+				listing->stale = TRUE;
+			}
+			else if (event->len > 0)
+				update_listing(listing, event->name, event->mask);
+		}
+	}
+#endif
+	return changed;
+}
+
+
+#if HAVE_SYS_INOTIFY_H
+/* Bring the listing's entry for name in line with the event. */
+static void update_listing(struct listing* listing, const gchar* name,
+		guint32 event_mask) {
+	File key;
+	gpointer orig_key;
+	gpointer value;
+	File* file = NULL;
+	gchar* full_path;
+	struct stat file_stat;
+	FileType type;
+
+	if (!listing->files)
+		listing->files = g_tree_new(filename_cmp);
+
+	/* Whatever happens, by_name is out of date. */
+	if (listing->by_name) {
+		g_ptr_array_free(listing->by_name, TRUE);
+		listing->by_name = NULL;
+	}
+
+	/* cmp_win sorts on the type as well, and all it's told apart by is
+	   whether it's a directory. */
+	key.name = (gchar*) name;
+	key.type = FT_DIRECTORY;
+	if (g_tree_lookup_extended(listing->files, &key, &orig_key, &value))
+		file = orig_key;
+	else if (filename_cmp == cmp_win) {
+		key.type = FT_REGULAR;
+		if (g_tree_lookup_extended(listing->files, &key, &orig_key, &value))
+			file = orig_key;
+	}
+
+	if (event_mask & (IN_DELETE | IN_MOVED_FROM)) {
+		if (file) {
+			g_tree_remove(listing->files, file);
+			listing->file_count--;
+			if (++listing->dead > MAX(listing->file_count, FILE_BLOCK))
+				compact_listing(listing);
+		}
+	}
+	else {
+		/* Created, moved in, or its attributes changed -- either way it's
+		   here now, so (re)determine its type. */
+		full_path = g_strconcat(listing->name, "/", name, NULL);
+		if (lstat(full_path, &file_stat) == -1)
+			type = FT_REGULAR;
+		else
+			type = determine_type(file_stat.st_mode);
+		g_free(full_path);
+
+		if (file && file->type != type) {
+			/* The type may be part of the sort key, so take it out of the
+			   tree while it changes. */
+			g_tree_remove(listing->files, file);
+			file->type = type;
+			g_tree_insert(listing->files, file, NULL);
+		}
+		else if (!file) {
+			g_tree_insert(listing->files,
+					make_new_file(listing, name, type), NULL);
+			listing->file_count++;
+		}
+	}
+}
+
+
+/* Move the live files into a fresh arena, leaving the deleted ones behind.
+   by_name has already been dropped. */
+static void compact_listing(struct listing* listing) {
+	struct listing old = *listing;
+
+	listing->blocks = NULL;
+	listing->block_used = 0;
+	listing->names = NULL;
+	listing->dead = 0;
+	listing->files = g_tree_new(filename_cmp);
+
+	g_tree_foreach(old.files, copy_traverse, listing);
+	g_tree_destroy(old.files);
+	free_arena(&old);
+}
+#endif
+
+
+static gint cmp_wd(gconstpointer a, gconstpointer b) {
+	return GPOINTER_TO_INT(a) - GPOINTER_TO_INT(b);
+}
+
+
+static gboolean reset_traverse(gpointer key, gpointer value, gpointer data) {
+	File* file = key;
+
+	file->selected = FS_NO;
+	file->shown = FALSE;
+	return FALSE;
+}
+
+
+static gboolean index_traverse(gpointer key, gpointer value, gpointer data) {
+	g_ptr_array_add(data, key);
+	return FALSE;
+}
+
+
+static gboolean copy_traverse(gpointer key, gpointer value, gpointer data) {
+	File* file = key;
+	struct listing* listing = data;
+
+	g_tree_insert(listing->files,
+			make_new_file(listing, file->name, file->type), NULL);
+	return FALSE;
+}
+
+
+/* Free the directory list built for the last expansion.  The files belong
+   to the cached listings. */
+static void free_dirs(Directory* head) {
+	Directory* next;
+
+	while (head) {
+		next = head->next_dir;
+		g_free(head->name);
+		g_free(head);
+		head = next;
+	}
+}
+
+
+/* Determine the type of a directory entry from d_type, which most
+   filesystems fill in.  That saves a stat() for everything but regular
+   files (which still need one for the executable bits) and entries of
+   unknown type, for which FT_COUNT is returned. */
+static FileType dirent_type(const struct dirent* entry) {
+#if HAVE_STRUCT_DIRENT_D_TYPE
+	switch (entry->d_type) {
+		case DT_DIR:
+			return FT_DIRECTORY;
+		case DT_LNK:
+			return FT_SYMLINK;
+		case DT_BLK:
+			return FT_BLOCKDEV;
+		case DT_CHR:
+			return FT_CHARDEV;
+		case DT_FIFO:
+			return FT_FIFO;
+		case DT_SOCK:
+			return FT_SOCKET;
+		default:
+			/* DT_REG or DT_UNKNOWN. */
+			break;
+	}
+#endif
+	return FT_COUNT;
+}
+
+
+/* Fill in the types of the given files of the open directory.  With enough
+   of them, the stats are handed to stat_ring_modes() to be done
+   concurrently, which matters on network filesystems. */
+static void stat_files(DIR* dirp, const gchar* dir_name, GPtrArray* files) {
+	File* file;
+	guint i;
+
+#if HAVE_DIRFD
+	if (files->len >= STAT_RING_MIN) {
+		gchar** names = g_new(gchar*, files->len);
+		mode_t* modes = g_new(mode_t, files->len);
+		gboolean done;
+
+		for (i = 0; i < files->len; i++) {
+			file = g_ptr_array_index(files, i);
+			names[i] = file->name;
+		}
+
+		done = stat_ring_modes(dirfd(dirp), names, files->len, modes);
+		if (done) {
+			for (i = 0; i < files->len; i++) {
+				file = g_ptr_array_index(files, i);
+				/* We don't want to just skip this; assume it's regular. */
+				file->type = modes[i] ? determine_type(modes[i]) : FT_REGULAR;
+			}
+		}
+
+		g_free(names);
+		g_free(modes);
+		if (done)
+			return;
+	}
+#endif
+
+	for (i = 0; i < files->len; i++) {
+		file = g_ptr_array_index(files, i);
+		file->type = stat_type(dirp, dir_name, file->name);
+	}
+}
+
+
+/* Stat a file in the open directory to find its type.  The stat is done
+   relative to the directory where possible, to save building and resolving
+   the full path. */
+static FileType stat_type(DIR* dirp, const gchar* dir_name,
+		const gchar* name) {
+	struct stat file_stat;
+	gint result;
+
+	/* Using lstat so that symbolic links are detected instead of
+	   followed.  May wish to switch at some point. */
+#if HAVE_FSTATAT && HAVE_DIRFD
+	result = fstatat(dirfd(dirp), name, &file_stat, AT_SYMLINK_NOFOLLOW);
+#else
+	gchar* full_path = g_strconcat(dir_name, "/", name, NULL);
+	result = lstat(full_path, &file_stat);
+	g_free(full_path);
+#endif
+
+	/* We don't want to just skip this; assume it's regular. */
+	if (result == -1)
+		return FT_REGULAR;
+	else
+		return determine_type(file_stat.st_mode);
+}
+
+
+static FileType determine_type(mode_t mode) {
+	if (S_ISREG(mode)) {
+		if ( (mode & S_IXUSR) == S_IXUSR ||
+		     (mode & S_IXGRP) == S_IXGRP ||
+			 (mode & S_IXOTH) == S_IXOTH    )
+			return FT_EXECUTABLE;
+		else
+			return FT_REGULAR;
+	}
+	else if (S_ISDIR(mode))
+		return FT_DIRECTORY;
+	else if (S_ISLNK(mode))
+		return FT_SYMLINK;
+	else if (S_ISBLK(mode))
+		return FT_BLOCKDEV;
+	else if (S_ISCHR(mode))
+		return FT_CHARDEV;
+	else if (S_ISFIFO(mode))
+		return FT_FIFO;
+	else if (S_ISSOCK(mode))
+		return FT_SOCKET;
+	else
+		return FT_REGULAR;
+}
+
+
+/* Takes a normalized path and returns the directory name.
+   I didn't like the POSIX version of dirname. */
+static gchar* vg_dirname(const gchar* path) {
+	gchar* dirname;
+	gint slash_pos;
+	size_t path_length;
+
+	path_length = strlen(path);
+
+	/* Find the last / in the path. */
+	slash_pos = find_prev(path, path_length - 1, '/');
+
+	if (*path != '/') {
+		/* It's a relative path, so need to append pwd. */
+
+		if (slash_pos == -1) {
+			/* The file is at pwd. */
+			dirname = g_malloc(pwd_length + 1);
+			(void)strcpy(dirname, pwd);
+		}
+		else {
+			/* Build an absolute path with pwd and the argument's path. */
+			dirname = g_malloc(pwd_length + 1 + slash_pos + 1);
+			(void)strcpy(dirname, pwd);
+			if (!STREQ(dirname, "/")) {
+				/* (Kludge for directories at root) */
+				(void)strcat(dirname, "/");
+			}
+			(void)strncat(dirname, path, slash_pos);
+			/* Just in case. */
+			*(dirname + pwd_length + 1 + slash_pos) = '\0';
+		}
+	}
+	else if (slash_pos == 0) {
+		/* The file is at root (or is root). */
+		dirname = g_malloc(2);
+		(void)strcpy(dirname, "/");
+	}
+	else {
+		/* It's an absolute path. */
+		dirname = g_malloc(slash_pos + 1);
+		(void)strncpy(dirname, path, slash_pos);
+		*(dirname + slash_pos) = '\0';
+	}
+
+	return dirname;
+}
+
+
+/* Takes a sanitized path and returns the base (file) name. */
+static gchar* vg_basename(const gchar* path) {
+	gchar* base;
+	gint slash_pos;
+	size_t path_length;
+
+	path_length = strlen(path);
+
+	/* Find the last / in the path. */
+	slash_pos = find_prev(path, path_length - 1, '/');
+
+	if (slash_pos == 0 && path_length == 1) {
+		/* It's root. */
+		base = g_malloc(2);
+		(void)strcpy(base, "/");
+	}
+	else if (slash_pos == -1) {
+		/* It's a relative path at pwd. */
+		base = g_malloc(path_length + 1);
+		(void)strcpy(base, path);
+	}
+	else {
+		base = g_malloc(path_length - slash_pos);
+		(void)strcpy(base, path + slash_pos + 1);
+	}
+
+	return base;
+}
+
+
+/* Removes repeated /'s and takes out the ending /, if present. */
+static gchar* normalize_path(const gchar* path, gboolean remove_trailing) {
+	gchar* norm;
+	gint i, norm_pos;
+	gboolean slash_seen;
+	size_t length;
+
+	if (!path)
+		return NULL;
+
+	length = strlen(path);
+	norm = g_malloc(length + 1);	/* We'll need at most this much memory. */
+	norm_pos = 0;
+
+	slash_seen = FALSE;
+	for (i = 0; i < length; i++) {
+
+		if (*(path + i) == '/') {
+			if (slash_seen)
+				continue;	/* Only copy the first slash. */
+			else {
+				slash_seen = TRUE;
+				*(norm + norm_pos) = '/';
+				norm_pos++;
+			}
+		}
+		else {
+			slash_seen = FALSE;
+			*(norm + norm_pos) = *(path + i);
+			norm_pos++;
+		}
+	}
+
+	*(norm + norm_pos) = '\0';
+
+	/* If remove_trailing == TRUE, strip off a trailing / (if any). */
+	if (remove_trailing && norm_pos > 1 && *(norm + norm_pos - 1) == '/')
+		*(norm + norm_pos - 1) = '\0';
+
+	return norm;
+}
+
+
+/* Return the position of the previous c from pos, or -1 if not found. */
+static gint find_prev(const gchar* string, gint pos, gchar c) {
+	gboolean found = FALSE;
+
+	while (pos >= 0) {
+		if ( *(string + pos) == c ) {
+			found = TRUE;
+			break;
+		}
+		pos--;
+	}
+
+	if (found)
+		return pos;
+	else
+		return -1;
+}
+
+
+/* Sort strictly by name (default ls style). */
+static gint cmp_ls(gconstpointer a, gconstpointer b) {
+	const File* aa = a;
+	const File* bb = b;
+
+	return (strcmp(aa->name, bb->name));
+}
+
+
+/* For sorting by_name, which holds File pointers. */
+static gint cmp_by_name(gconstpointer a, gconstpointer b) {
+	const File* aa = *(File* const*) a;
+	const File* bb = *(File* const*) b;
+
+	return strcmp(aa->name, bb->name);
+}
+
+
+/* Sort by type (dir first), then by name (default Windows style). */
+static gint cmp_win(gconstpointer a, gconstpointer b) {
+	const File* aa = a;
+	const File* bb = b;
+
+	if (aa->type == FT_DIRECTORY) {
+		if (bb->type == FT_DIRECTORY)
+			return strcmp(aa->name, bb->name);
+		else
+			return -1;
+	}
+	else {
+		if (bb->type == FT_DIRECTORY)
+			return 1;
+		else
+			return strcmp(aa->name, bb->name);
+	}
+}
+
+
+/* Replace mask_set with one compiled from the given mask. */
+static void compile_mask(const gchar* mask) {
+	struct mask** masks;
+	struct mask** mask_iter;
+	gchar* mask_copy;
+
+	glob_set_free(mask_set);
+	g_free(mask_string);
+
+	mask_copy = g_strdup(mask);
+	masks = split(mask_copy);
+
+	mask_set = glob_set_new();
+	for (mask_iter = masks; *mask_iter; mask_iter++) {
+		glob_set_add(mask_set, (*mask_iter)->pattern,
+				(*mask_iter)->dirs_only ? MASK_DIRS : MASK_ANY);
+	}
+
+	free_masks(masks);
+	g_free(mask_copy);
+	mask_string = g_strdup(mask);
+}
+
+
+/* Split the given mask into words (mini-masks). E.g.:
+	   "*.c *.h" is split into "*.c" and "*.h".
+   The mask is modified in place, and the returned patterns point into it.
+   This function performs very little error checking, as it's assumed the
+   mask has been sanitized by vgseer. */
+static struct mask** split(gchar* mask) {
+
+	g_return_val_if_fail(mask != NULL, NULL);
+
+	GPtrArray* ptrarray = g_ptr_array_new();
+	gchar* start = NULL;
+	gchar* end = NULL;
+
+	mask = g_strchug(mask);
+
+	/* Split the mask into words. */
+	start = end = mask;
+	while (*start != '\0') {
+
+		switch (*end) {
+
+			case ' ':
+				/* End of word. */
+				*end = '\0';
+				g_ptr_array_add(ptrarray, start);
+				start = end + 1;
+				while (*start == ' ')
+					start++;
+				end = start;
+				continue;
+				break;
+
+			case '\0':
+				g_ptr_array_add(ptrarray, start);
+				start = end;
+				break;
+
+			case '\\':
+				end++;
+				break;
+
+			case '\"':
+				end++;
+				while (*end != '\"')
+					end++;
+				break;
+
+			case '\'':
+				end++;
+				while (*end != '\'')
+					end++;
+				break;
+		}
+
+		end++;
+	}
+
+	/* Take the patterns from the pointer array and check to see if any of
+	   them have the trailing slash special case for matching directories. */
+	struct mask** array = g_new(struct mask*, ptrarray->len + 1);
+	gchar* p;
+	gint i;
+	for (i = 0; i < ptrarray->len; i++) {
+		array[i] = g_new(struct mask, 1);
+		array[i]->pattern = ptrarray->pdata[i];
+		for (p = array[i]->pattern; *p != '\0'; p++)
+			;
+		if (p == array[i]->pattern)
+			array[i]->dirs_only = FALSE;
+		else {
+			p--;
+			if (*p == '/') {
+				array[i]->dirs_only = TRUE;
+				*p = '\0';
+			}
+			else
+				array[i]->dirs_only = FALSE;
+		}
+	}
+	/* Delimit with NULL. */
+	array[i] = NULL;
+
+	g_ptr_array_free(ptrarray, TRUE);
+	return array;
+}
+
+
+static void free_masks(struct mask** array) {
+	struct mask** iter;
+
+	if (array) {
+		for (iter = array; *iter; iter++)
+			g_free(*iter);
+		g_free(array);
+	}
+}
@@ -0,0 +1,121 @@
+/*
+	Copyright (C) 2004, 2005 Stephen Bach
+	This file is part of the Viewglob package.
+
+	Viewglob is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Viewglob is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Viewglob; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef EXPAND_H
+#define EXPAND_H
+
+#include "common.h"
+#include "file-types.h"
+
+G_BEGIN_DECLS
+
+
+/* Order in which to list the directories:
+	SO_DESCENDING: listed in order of appearance on the command line.
+	SO_ASCENDING: listed in reverse order.
+	SO_ASCENDING_PWD_FIRST: listed in reverse order with pwd first. */
+enum sort_order {
+	SO_DESCENDING,
+	SO_ASCENDING,
+	SO_ASCENDING_PWD_FIRST,
+};
+
+/* How the results are written out:
+	EF_TEXT: the traditional vgexpand output.  Per directory,
+	         "selected total hidden name\n", then "\tS T name\n" per file, and
+	         a final "\n".
+	EF_BINARY: EXPAND_DATA_MAGIC, then per directory an ER_DIR byte, the
+	         three counts as 32-bit integers, and the name; then per file an
+	         ER_FILE byte, the FileSelection and FileType as bytes, and the
+	         name.  Names are a 16-bit length followed by the name and a NUL
+	         (not counted in the length), so they can be used in place.
+	         Integers are in network byte order.
+   In both, pwd's name is prefixed with PWD_CHAR.  A directory which couldn't
+   be read within the expansion's budget (see expand_set_budget()) has no
+   files after it; in the text format its counts are EXPAND_INCOMPLETE_COUNT,
+   and in the binary format its record is ER_INCOMPLETE instead of ER_DIR. */
+enum expand_format {
+	EF_TEXT,
+	EF_BINARY,
+};
+
+#define EXPAND_INCOMPLETE_COUNT "?"
+
+#define EXPAND_DATA_MAGIC '\001'
+
+/* Binary results may also be sent as a delta from the previous results
+   (see expand-delta.c), if vgd accepts EXPAND_DELTA_OFFER. */
+#define EXPAND_DELTA_MAGIC '\002'
+#define EXPAND_DELTA_OFFER "expand-delta"
+
+enum expand_record {
+	ER_DIR = 'D',
+	ER_FILE = 'F',
+	ER_INCOMPLETE = 'I',
+};
+
+typedef struct _File File;
+struct _File {
+	gchar* name;
+	FileSelection selected;
+	FileType type;
+	gboolean shown;
+};
+
+typedef struct _Directory Directory;
+struct _Directory {
+	gchar* name;
+	dev_t dev_id;
+	ino_t inode;
+	gint selected_count;
+	gint file_count;
+	gint hidden_count;
+	GTree* files;
+	gboolean is_pwd;
+	gboolean incomplete;  /* Its listing wasn't read in time. */
+	Directory* next_dir;
+	GPtrArray* by_name;  /* The files in strcmp() order (the listing's). */
+};
+
+struct mask {
+	gchar* pattern;
+	gboolean dirs_only;
+};
+
+
+void     expand_set_opts(const gchar* opts);
+void     expand_set_format(enum expand_format f);
+gboolean expand(GString* report, const gchar* pwd, const gchar* mask,
+		gint argc, gchar** argv);
+gboolean expand_words(GString* report, const gchar* pwd, const gchar* mask,
+		gint argc, gchar** argv);
+void     expand_set_budget(guint msec);
+gint     expand_watch_fd(void);
+gint     expand_pending_fd(void);
+gboolean expand_process_events(void);
+
+gboolean expand_delta_make(GString* delta, const GString* old_results,
+		guint32 gen, const GString* new_results);
+gboolean expand_delta_apply(GString* results, const GString* old_results,
+		guint32 gen, const gchar* delta, gsize len);
+
+
+G_END_DECLS
+
+#endif /* !EXPAND_H */
@@ -0,0 +1,1120 @@
+/*
+	Copyright (C) 2004, 2005 Stephen Bach
+	This file is part of the Viewglob package.
+
+	Viewglob is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Viewglob is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Viewglob; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* Word splitting, brace expansion and pathname matching, done the way bash
+   and zsh would do them on a command line which has already been through
+   vgseer's sanitize().  This lets the expansion be done against the cached
+   directory listings instead of having the sandbox shell read every
+   directory and hand over the results as arguments. */
+
+#include "config.h"
+
+#include "common.h"
+#include "glob-match.h"
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+
+enum node_type {
+	N_CHAR,
+	N_ANY,
+	N_STAR,
+	N_CLASS,
+	N_EXT,
+};
+
+/* A pattern is compiled into a flat list of nodes.  Extended globs (e.g.
+   "@(foo|bar)") hold a compiled pattern for each alternative. */
+struct node {
+	enum node_type type;
+	guchar c;            /* N_CHAR */
+	guint32 set[8];      /* N_CLASS: one bit per byte value. */
+	gchar op;            /* N_EXT: one of "?*+@!". */
+	GPtrArray* alts;     /* N_EXT */
+};
+
+struct _GlobPattern {
+	struct node* nodes;
+	gint count;
+};
+
+/* A set of patterns matched together.  The ones made only of characters,
+   '?', '*' and bracket expressions are run as a single NFA (a position per
+   node, plus one past the end which accepts), which is turned into a DFA
+   a state at a time as names need it.  Once it's warmed up, a name costs a
+   table lookup per byte, however many patterns there are.  Extended globs
+   don't fit, so they're tried one at a time. */
+struct dfa_state {
+	guint32* positions;   /* The NFA positions this state stands for. */
+	gint width;           /* guint32s in positions. */
+	gboolean leading;     /* At the start of the name (the period rule). */
+	gboolean dead;        /* No positions, so nothing can match. */
+	guint flags;          /* Of the patterns accepted here. */
+	gint index;
+	gint next[256];       /* State index on each byte, or -1 if unknown. */
+};
+
+struct _GlobSet {
+	GPtrArray* patterns;
+	GPtrArray* pos_node;  /* Per NFA position, the node (NULL to accept) */
+	GArray* pos_flags;    /* and the flags it accepts with. */
+	GArray* starts;       /* First position of each pattern. */
+	gint width;
+
+	GPtrArray* ext;       /* Patterns matched one at a time, */
+	GArray* ext_flags;    /* and their flags. */
+
+	GPtrArray* states;    /* The DFA so far; the first is the start. */
+	GHashTable* state_table;
+};
+
+struct char_class {
+	const gchar* name;
+	int (*is)(int c);
+};
+
+static const struct char_class classes[] = {
+	{ "alnum",  isalnum },
+	{ "alpha",  isalpha },
+	{ "blank",  isblank },
+	{ "cntrl",  iscntrl },
+	{ "digit",  isdigit },
+	{ "graph",  isgraph },
+	{ "lower",  islower },
+	{ "print",  isprint },
+	{ "punct",  ispunct },
+	{ "space",  isspace },
+	{ "upper",  isupper },
+	{ "xdigit", isxdigit },
+};
+
+
+static void        add_quoted(GString* word, gchar c);
+static const gchar* brace_close(const gchar* open, GArray* commas);
+static GPtrArray*  brace_sequence(const gchar* start, const gchar* end);
+static gboolean    parse_seq_int(const gchar* s, glong* n, gint* width);
+
+static gint     parse_class(const gchar* p, gsize len, struct node* node);
+static gint     ext_close(const gchar* p, gsize open, gsize len);
+static void     set_bit(struct node* node, guchar c);
+static gboolean match_nodes(const struct node* nodes, gint n,
+		const gchar* s, const gchar* end);
+static gboolean match_ext(const struct node* nodes, gint n,
+		const gchar* s, const gchar* end);
+static gboolean match_repeat(const struct node* nodes, gint n,
+		const gchar* s, const gchar* end);
+static gboolean match_alt(const struct node* node,
+		const gchar* s, const gchar* end);
+
+static void     dfa_reset(GlobSet* set);
+static void     dfa_start(GlobSet* set);
+static gint     dfa_state(GlobSet* set, guint32* positions, gboolean leading);
+static guint32* dfa_step(GlobSet* set, const struct dfa_state* state,
+		guchar c);
+static void     dfa_closure(GlobSet* set, guint32* positions);
+static guint    hash_state(gconstpointer key);
+static gboolean equal_state(gconstpointer a, gconstpointer b);
+static void     free_state(gpointer data);
+
+#define POS_IS_SET(p, i) ((p)[(i) / 32] & (1U << ((i) % 32)))
+#define POS_SET(p, i) ((p)[(i) / 32] |= 1U << ((i) % 32))
+
+
+/* Break a sanitized command line into words in pattern form.  If the command
+   uses something the shell might give a meaning we can't be sure of (zsh's
+   glob qualifiers and extended_glob operators, "**" which is recursive with
+   globstar, or bash's extglob forms when extglob is off), NULL is returned
+   and the shell should be asked to do the expansion instead.  The same goes
+   for any glob at all when options (GLOB_OPT_*) say the shell would match it
+   differently. */
+gchar** glob_split(const gchar* cmd, enum shell_type shell, guint options) {
+
+	g_return_val_if_fail(cmd != NULL, NULL);
+
+	enum { Q_NONE, Q_SINGLE, Q_DOUBLE } quote = Q_NONE;
+	GPtrArray* words = g_ptr_array_new();
+	GString* word = g_string_new(NULL);
+	gboolean have_word = FALSE;
+	gboolean native = TRUE;
+	gint parens = 0;
+	const gchar* p;
+
+	for (p = cmd; *p != '\0' && native; p++) {
+
+		if (quote == Q_SINGLE) {
+			if (*p == '\'')
+				quote = Q_NONE;
+			else
+				add_quoted(word, *p);
+			continue;
+		}
+		else if (quote == Q_DOUBLE) {
+			if (*p == '\"')
+				quote = Q_NONE;
+			else if (*p == '\\' && *(p + 1) != '\0' &&
+					strchr("$`\"\\", *(p + 1)))
+				add_quoted(word, *++p);
+			else
+				add_quoted(word, *p);
+			continue;
+		}
+
+		switch (*p) {
+			case '\'':
+				quote = Q_SINGLE;
+				break;
+			case '\"':
+				quote = Q_DOUBLE;
+				break;
+			case '\\':
+				if (*(p + 1) != '\0')
+					add_quoted(word, *++p);
+				break;
+
+			case ' ':
+			case '\t':
+			case '\n':
+				/* Whitespace inside an extglob is part of the pattern. */
+				if (parens > 0) {
+					word = g_string_append_c(word, *p);
+					break;
+				}
+				if (have_word) {
+					g_ptr_array_add(words, g_string_free(word, FALSE));
+					word = g_string_new(NULL);
+					have_word = FALSE;
+				}
+				continue;
+
+			case '(':
+			case ')':
+				if (shell == ST_ZSH || !(options & GLOB_OPT_EXTGLOB))
+					native = FALSE;
+				else if (*p == '(')
+					parens++;
+				else if (parens > 0)
+					parens--;
+				word = g_string_append_c(word, *p);
+				break;
+
+			case '*':
+				if (*(p + 1) == '*' || (options & GLOB_OPT_FOREIGN))
+					native = FALSE;
+				word = g_string_append_c(word, *p);
+				break;
+
+			case '?':
+			case '[':
+				if (options & GLOB_OPT_FOREIGN)
+					native = FALSE;
+				word = g_string_append_c(word, *p);
+				break;
+
+			case '#':
+				/* A comment in bash, an operator under zsh's
+				   extended_glob. */
+				if (shell == ST_ZSH)
+					native = FALSE;
+				else if (!have_word)
+					goto done;
+				word = g_string_append_c(word, *p);
+				break;
+
+			case '^':
+				if (shell == ST_ZSH)
+					native = FALSE;
+				word = g_string_append_c(word, *p);
+				break;
+
+			case '~':
+				if (shell == ST_ZSH && have_word)
+					native = FALSE;
+				word = g_string_append_c(word, *p);
+				break;
+
+			case '=':
+				/* "=cmd" is a path search in zsh. */
+				if (shell == ST_ZSH && !have_word)
+					native = FALSE;
+				word = g_string_append_c(word, *p);
+				break;
+
+			default:
+				word = g_string_append_c(word, *p);
+				break;
+		}
+		have_word = TRUE;
+	}
+
+done:
+	if (!native) {
+		g_string_free(word, TRUE);
+		g_ptr_array_foreach(words, (GFunc) g_free, NULL);
+		g_ptr_array_free(words, TRUE);
+		return NULL;
+	}
+
+	if (have_word)
+		g_ptr_array_add(words, g_string_free(word, FALSE));
+	else
+		g_string_free(word, TRUE);
+	g_ptr_array_add(words, NULL);
+
+	return (gchar**) g_ptr_array_free(words, FALSE);
+}
+
+
+/* Quoted characters are escaped, except for '/' which is never special to a
+   glob and is what the words get split into components on. */
+static void add_quoted(GString* word, gchar c) {
+	if (c != '/')
+		word = g_string_append_c(word, '\\');
+	word = g_string_append_c(word, c);
+}
+
+
+/* Append the brace expansion of word (in pattern form) to words.  Like
+   bash, comma lists and sequences ({1..10}, {a..e}, {0..20..5}) are
+   expanded, and braces which are neither are left alone. */
+void glob_braces(GPtrArray* words, const gchar* word) {
+
+	g_return_if_fail(words != NULL);
+	g_return_if_fail(word != NULL);
+
+	const gchar* open;
+	const gchar* close;
+	const gchar* alt;
+	GArray* commas;
+	GPtrArray* seq;
+	gchar* expanded;
+	gint i;
+
+	if (words->len >= GLOB_MAX_WORDS)
+		return;
+
+	commas = g_array_new(FALSE, FALSE, sizeof(const gchar*));
+
+	for (open = word; *open != '\0'; open++) {
+
+		if (*open == '\\') {
+			if (*(open + 1) != '\0')
+				open++;
+			continue;
+		}
+		else if (*open != '{')
+			continue;
+
+		commas = g_array_set_size(commas, 0);
+		if ( (close = brace_close(open, commas)) == NULL)
+			continue;
+
+		if (commas->len > 0) {
+			alt = open + 1;
+			for (i = 0; i <= commas->len; i++) {
+				const gchar* alt_end = i < commas->len ?
+					g_array_index(commas, const gchar*, i) : close;
+				expanded = g_strdup_printf("%.*s%.*s%s",
+						(gint) (open - word), word,
+						(gint) (alt_end - alt), alt, close + 1);
+				glob_braces(words, expanded);
+				g_free(expanded);
+				alt = alt_end + 1;
+			}
+			g_array_free(commas, TRUE);
+			return;
+		}
+		else if ( (seq = brace_sequence(open + 1, close)) != NULL) {
+			for (i = 0; i < seq->len; i++) {
+				expanded = g_strdup_printf("%.*s%s%s",
+						(gint) (open - word), word,
+						(gchar*) g_ptr_array_index(seq, i), close + 1);
+				glob_braces(words, expanded);
+				g_free(expanded);
+				g_free(g_ptr_array_index(seq, i));
+			}
+			g_ptr_array_free(seq, TRUE);
+			g_array_free(commas, TRUE);
+			return;
+		}
+	}
+
+	g_array_free(commas, TRUE);
+	g_ptr_array_add(words, g_strdup(word));
+}
+
+
+/* Find the brace matching the one at open, noting the positions of the
+   commas at its own level. */
+static const gchar* brace_close(const gchar* open, GArray* commas) {
+	const gchar* p;
+	gint depth = 0;
+
+	for (p = open; *p != '\0'; p++) {
+		switch (*p) {
+			case '\\':
+				if (*(p + 1) != '\0')
+					p++;
+				break;
+			case '{':
+				depth++;
+				break;
+			case '}':
+				if (--depth == 0)
+					return p;
+				break;
+			case ',':
+				if (depth == 1)
+					commas = g_array_append_val(commas, p);
+				break;
+			default:
+				break;
+		}
+	}
+
+	return NULL;
+}
+
+
+/* If the text between the braces is a sequence expression, return its
+   terms. */
+static GPtrArray* brace_sequence(const gchar* start, const gchar* end) {
+	gchar* text;
+	gchar** parts;
+	GPtrArray* seq = NULL;
+	glong first, last, incr = 1, n;
+	gint width = 0, w;
+	gboolean chars;
+
+	text = g_strndup(start, end - start);
+	parts = g_strsplit(text, "..", 3);
+	g_free(text);
+
+	if (!parts[0] || !parts[1] || strchr(parts[1], '.'))
+		goto out;
+	if (parts[2] && !parse_seq_int(parts[2], &incr, &w))
+		goto out;
+
+	if (parse_seq_int(parts[0], &first, &width) &&
+			parse_seq_int(parts[1], &last, &w)) {
+		width = MAX(width, w);
+		chars = FALSE;
+	}
+	else if (strlen(parts[0]) == 1 && strlen(parts[1]) == 1 &&
+			*parts[0] != '\\' && *parts[1] != '\\') {
+		first = (guchar) *parts[0];
+		last = (guchar) *parts[1];
+		chars = TRUE;
+	}
+	else
+		goto out;
+
+	incr = ABS(incr);
+	if (incr == 0)
+		incr = 1;
+	if (first > last)
+		incr = -incr;
+
+	seq = g_ptr_array_new();
+	for (n = first; incr > 0 ? n <= last : n >= last; n += incr) {
+		if (seq->len >= GLOB_MAX_WORDS)
+			break;
+		if (chars)
+			g_ptr_array_add(seq, g_strdup_printf("%c", (gchar) n));
+		else
+			g_ptr_array_add(seq, g_strdup_printf("%0*ld", width, n));
+	}
+
+out:
+	g_strfreev(parts);
+	return seq;
+}
+
+
+/* Parse a sequence endpoint.  A leading zero pads every term to the width
+   of the widest endpoint. */
+static gboolean parse_seq_int(const gchar* s, glong* n, gint* width) {
+	const gchar* digits = s;
+	gchar* end;
+
+	if (*digits == '-' || *digits == '+')
+		digits++;
+	if (!isdigit((guchar) *digits))
+		return FALSE;
+
+	*n = strtol(s, &end, 10);
+	if (*end != '\0')
+		return FALSE;
+
+	*width = (*digits == '0' && *(digits + 1) != '\0') ? strlen(s) : 0;
+	return TRUE;
+}
+
+
+/* Whether the pattern has anything in it that would make the shell match it
+   against a directory's contents. */
+gboolean glob_has_magic(const gchar* pattern, gsize len) {
+
+	g_return_val_if_fail(pattern != NULL, FALSE);
+
+	gsize i;
+
+	for (i = 0; i < len; i++) {
+		switch (*(pattern + i)) {
+			case '\\':
+				i++;
+				break;
+			case '*':
+			case '?':
+			case '[':
+				return TRUE;
+			case '+':
+			case '@':
+			case '!':
+				if (i + 1 < len && *(pattern + i + 1) == '(')
+					return TRUE;
+				break;
+			default:
+				break;
+		}
+	}
+
+	return FALSE;
+}
+
+
+/* The literal text of a pattern with no magic. */
+gchar* glob_unescape(const gchar* pattern, gsize len) {
+
+	g_return_val_if_fail(pattern != NULL, NULL);
+
+	gchar* text = g_malloc(len + 1);
+	gsize i, j;
+
+	for (i = j = 0; i < len; i++) {
+		if (*(pattern + i) == '\\' && i + 1 < len)
+			i++;
+		*(text + j++) = *(pattern + i);
+	}
+	*(text + j) = '\0';
+
+	return text;
+}
+
+
+/* Compile a single path component (no '/') in pattern form. */
+GlobPattern* glob_compile(const gchar* pattern, gsize len) {
+
+	g_return_val_if_fail(pattern != NULL, NULL);
+
+	GArray* nodes = g_array_new(FALSE, TRUE, sizeof(struct node));
+	GlobPattern* gp;
+	struct node node;
+	gsize i = 0;
+	gint close, used;
+
+	while (i < len) {
+		gchar c = *(pattern + i);
+
+		memset(&node, 0, sizeof(node));
+
+		if (c == '\\' && i + 1 < len) {
+			node.type = N_CHAR;
+			node.c = *(pattern + i + 1);
+			i += 2;
+		}
+		else if (strchr("?*+@!", c) && i + 1 < len &&
+				*(pattern + i + 1) == '(' &&
+				(close = ext_close(pattern, i + 1, len)) != -1) {
+			gsize alt = i + 2;
+			gsize j;
+			gint depth = 0;
+
+			node.type = N_EXT;
+			node.op = c;
+			node.alts = g_ptr_array_new();
+			for (j = alt; j <= close; j++) {
+				gchar d = *(pattern + j);
+				if (d == '\\')
+					j++;
+				else if (d == '(')
+					depth++;
+				else if (d == ')' && depth > 0)
+					depth--;
+				else if ((d == '|' && depth == 0) || j == close) {
+					g_ptr_array_add(node.alts,
+							glob_compile(pattern + alt, j - alt));
+					alt = j + 1;
+				}
+			}
+			i = close + 1;
+		}
+		else if (c == '*') {
+			node.type = N_STAR;
+			while (i < len && *(pattern + i) == '*')
+				i++;
+		}
+		else if (c == '?') {
+			node.type = N_ANY;
+			i++;
+		}
+		else if (c == '[' &&
+				(used = parse_class(pattern + i, len - i, &node)) > 0) {
+			node.type = N_CLASS;
+			i += used;
+		}
+		else {
+			node.type = N_CHAR;
+			node.c = c;
+			i++;
+		}
+
+		nodes = g_array_append_val(nodes, node);
+	}
+
+	gp = g_new(GlobPattern, 1);
+	gp->count = nodes->len;
+	gp->nodes = (struct node*) g_array_free(nodes, FALSE);
+	return gp;
+}
+
+
+/* Find the parenthesis closing the one at open, or -1. */
+static gint ext_close(const gchar* p, gsize open, gsize len) {
+	gsize i;
+	gint depth = 0;
+
+	for (i = open; i < len; i++) {
+		if (*(p + i) == '\\')
+			i++;
+		else if (*(p + i) == '(')
+			depth++;
+		else if (*(p + i) == ')' && --depth == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+
+/* Parse a bracket expression into node's set.  Returns the number of
+   characters used, or 0 if the bracket isn't closed (and so is just a
+   bracket). */
+static gint parse_class(const gchar* p, gsize len, struct node* node) {
+	gsize i = 1;
+	gboolean negate = FALSE;
+	gboolean first = TRUE;
+	guchar lo, hi;
+	gint k, c;
+
+	if (i < len && (*(p + i) == '!' || *(p + i) == '^')) {
+		negate = TRUE;
+		i++;
+	}
+
+	while (i < len) {
+
+		if (*(p + i) == ']' && !first) {
+			if (negate) {
+				for (k = 0; k < G_N_ELEMENTS(node->set); k++)
+					node->set[k] = ~node->set[k];
+			}
+			return i + 1;
+		}
+		first = FALSE;
+
+		/* [:class:] */
+		if (*(p + i) == '[' && i + 1 < len && *(p + i + 1) == ':') {
+			const gchar* name = p + i + 2;
+			const gchar* name_end = g_strstr_len(name, len - i - 2, ":]");
+			if (name_end) {
+				for (k = 0; k < G_N_ELEMENTS(classes); k++) {
+					if (strlen(classes[k].name) == name_end - name &&
+							strncmp(classes[k].name, name,
+								name_end - name) == 0) {
+						for (c = 0; c < 256; c++) {
+							if (classes[k].is(c))
+								set_bit(node, c);
+						}
+					}
+				}
+				i = name_end + 2 - p;
+				continue;
+			}
+		}
+
+		if (*(p + i) == '\\' && i + 1 < len)
+			i++;
+		lo = *(p + i++);
+
+		/* A range, unless the '-' is last. */
+		if (i + 1 < len && *(p + i) == '-' && *(p + i + 1) != ']') {
+			i++;
+			if (*(p + i) == '\\' && i + 1 < len)
+				i++;
+			hi = *(p + i++);
+			for (c = lo; c <= hi; c++)
+				set_bit(node, c);
+		}
+		else
+			set_bit(node, lo);
+	}
+
+	return 0;
+}
+
+
+static void set_bit(struct node* node, guchar c) {
+	node->set[c / 32] |= 1U << (c % 32);
+}
+
+
+/* Match a file name against a compiled pattern.  As in the shells, a leading
+   dot has to be matched explicitly. */
+gboolean glob_match(const GlobPattern* gp, const gchar* name) {
+
+	g_return_val_if_fail(gp != NULL, FALSE);
+	g_return_val_if_fail(name != NULL, FALSE);
+
+	if (*name == '.' &&
+			(gp->count == 0 || gp->nodes->type != N_CHAR ||
+			 gp->nodes->c != '.'))
+		return FALSE;
+
+	return match_nodes(gp->nodes, gp->count, name, name + strlen(name));
+}
+
+
+static gboolean match_nodes(const struct node* nodes, gint n,
+		const gchar* s, const gchar* end) {
+	const gchar* t;
+	guchar c;
+
+	for (; n > 0; nodes++, n--) {
+		switch (nodes->type) {
+			case N_CHAR:
+				if (s == end || (guchar) *s != nodes->c)
+					return FALSE;
+				s++;
+				break;
+
+			case N_ANY:
+				if (s == end)
+					return FALSE;
+				s++;
+				break;
+
+			case N_CLASS:
+				if (s == end)
+					return FALSE;
+				c = *s;
+				if (!(nodes->set[c / 32] & (1U << (c % 32))))
+					return FALSE;
+				s++;
+				break;
+
+			case N_STAR:
+				if (n == 1)
+					return TRUE;
+				for (t = s; t <= end; t++) {
+					/* Only bother where a literal could follow. */
+					if ((nodes + 1)->type == N_CHAR &&
+							(t == end || (guchar) *t != (nodes + 1)->c))
+						continue;
+					if (match_nodes(nodes + 1, n - 1, t, end))
+						return TRUE;
+				}
+				return FALSE;
+
+			case N_EXT:
+				return match_ext(nodes, n, s, end);
+
+			default:
+				g_return_val_if_reached(FALSE);
+		}
+	}
+
+	return s == end;
+}
+
+
+/* nodes starts with an extglob; try it against each prefix of s, with the
+   rest of the pattern taking what's left. */
+static gboolean match_ext(const struct node* nodes, gint n,
+		const gchar* s, const gchar* end) {
+	const gchar* t;
+
+	switch (nodes->op) {
+		case '?':
+			if (match_nodes(nodes + 1, n - 1, s, end))
+				return TRUE;
+			/* Fall through. */
+		case '@':
+			for (t = s; t <= end; t++) {
+				if (match_alt(nodes, s, t) &&
+						match_nodes(nodes + 1, n - 1, t, end))
+					return TRUE;
+			}
+			return FALSE;
+
+		case '*':
+			return match_repeat(nodes, n, s, end);
+
+		case '+':
+			for (t = s; t <= end; t++) {
+				if (match_alt(nodes, s, t) &&
+						match_repeat(nodes, n, t, end))
+					return TRUE;
+			}
+			return FALSE;
+
+		case '!':
+			for (t = s; t <= end; t++) {
+				if (!match_alt(nodes, s, t) &&
+						match_nodes(nodes + 1, n - 1, t, end))
+					return TRUE;
+			}
+			return FALSE;
+
+		default:
+			g_return_val_if_reached(FALSE);
+	}
+}
+
+
+/* Zero or more (non-empty) repetitions of the extglob, then the rest. */
+static gboolean match_repeat(const struct node* nodes, gint n,
+		const gchar* s, const gchar* end) {
+	const gchar* t;
+
+	if (match_nodes(nodes + 1, n - 1, s, end))
+		return TRUE;
+
+	for (t = s + 1; t <= end; t++) {
+		if (match_alt(nodes, s, t) && match_repeat(nodes, n, t, end))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+static gboolean match_alt(const struct node* node,
+		const gchar* s, const gchar* end) {
+	const GlobPattern* alt;
+	gint i;
+
+	for (i = 0; i < node->alts->len; i++) {
+		alt = g_ptr_array_index(node->alts, i);
+		if (match_nodes(alt->nodes, alt->count, s, end))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+
+void glob_free(GlobPattern* gp) {
+	gint i, j;
+
+	if (!gp)
+		return;
+
+	for (i = 0; i < gp->count; i++) {
+		if (gp->nodes[i].type == N_EXT) {
+			for (j = 0; j < gp->nodes[i].alts->len; j++)
+				glob_free(g_ptr_array_index(gp->nodes[i].alts, j));
+			g_ptr_array_free(gp->nodes[i].alts, TRUE);
+		}
+	}
+	g_free(gp->nodes);
+	g_free(gp);
+}
+
+
+GlobSet* glob_set_new(void) {
+	GlobSet* set = g_new(GlobSet, 1);
+
+	set->patterns = g_ptr_array_new();
+	set->pos_node = g_ptr_array_new();
+	set->pos_flags = g_array_new(FALSE, FALSE, sizeof(guint));
+	set->starts = g_array_new(FALSE, FALSE, sizeof(gint));
+	set->width = 0;
+	set->ext = g_ptr_array_new();
+	set->ext_flags = g_array_new(FALSE, FALSE, sizeof(guint));
+	set->states = g_ptr_array_new();
+	set->state_table = NULL;
+
+	return set;
+}
+
+
+/* Add a pattern (in fnmatch() form) to the set.  glob_set_match() returns
+   the flags of every pattern a name matches, or'ed together. */
+void glob_set_add(GlobSet* set, const gchar* pattern, guint flags) {
+
+	g_return_if_fail(set != NULL);
+	g_return_if_fail(pattern != NULL);
+
+	GlobPattern* gp = glob_compile(pattern, strlen(pattern));
+	guint accept;
+	gint i, pos;
+
+	for (i = 0; i < gp->count; i++) {
+		if (gp->nodes[i].type == N_EXT) {
+			g_ptr_array_add(set->ext, gp);
+			set->ext_flags = g_array_append_val(set->ext_flags, flags);
+			return;
+		}
+	}
+
+	g_ptr_array_add(set->patterns, gp);
+	pos = set->pos_node->len;
+	set->starts = g_array_append_val(set->starts, pos);
+	for (i = 0; i <= gp->count; i++) {
+		accept = i < gp->count ? 0 : flags;
+		g_ptr_array_add(set->pos_node,
+				i < gp->count ? gp->nodes + i : NULL);
+		set->pos_flags = g_array_append_val(set->pos_flags, accept);
+	}
+	set->width = (set->pos_node->len + 31) / 32;
+
+	/* The states built so far don't know about this pattern. */
+	dfa_reset(set);
+}
+
+
+guint glob_set_match(GlobSet* set, const gchar* name) {
+
+	g_return_val_if_fail(set != NULL, 0);
+	g_return_val_if_fail(name != NULL, 0);
+
+	const guchar* p;
+	struct dfa_state* state;
+	guint32* positions;
+	guint flags = 0;
+	gint i, next;
+
+	for (i = 0; i < set->ext->len; i++) {
+		if (glob_match(g_ptr_array_index(set->ext, i), name))
+			flags |= g_array_index(set->ext_flags, guint, i);
+	}
+
+	if (set->patterns->len == 0)
+		return flags;
+
+	if (set->states->len == 0)
+		dfa_start(set);
+
+	state = g_ptr_array_index(set->states, 0);
+	for (p = (const guchar*) name; *p != '\0' && !state->dead; p++) {
+		next = state->next[*p];
+		if (next == -1) {
+			positions = dfa_step(set, state, *p);
+			if (set->states->len >= GLOB_SET_MAX_STATES) {
+				/* Too many names have gone different ways; start
+				   over rather than let the table grow. */
+				dfa_reset(set);
+				dfa_start(set);
+				next = dfa_state(set, positions, FALSE);
+			}
+			else {
+				next = dfa_state(set, positions, FALSE);
+				state->next[*p] = next;
+			}
+		}
+		state = g_ptr_array_index(set->states, next);
+	}
+
+	return flags | state->flags;
+}
+
+
+void glob_set_free(GlobSet* set) {
+	gint i;
+
+	if (!set)
+		return;
+
+	if (set->state_table)
+		g_hash_table_destroy(set->state_table);
+	g_ptr_array_free(set->states, TRUE);
+
+	for (i = 0; i < set->patterns->len; i++)
+		glob_free(g_ptr_array_index(set->patterns, i));
+	for (i = 0; i < set->ext->len; i++)
+		glob_free(g_ptr_array_index(set->ext, i));
+	g_ptr_array_free(set->patterns, TRUE);
+	g_ptr_array_free(set->pos_node, TRUE);
+	g_array_free(set->pos_flags, TRUE);
+	g_array_free(set->starts, TRUE);
+	g_ptr_array_free(set->ext, TRUE);
+	g_array_free(set->ext_flags, TRUE);
+	g_free(set);
+}
+
+
+static void dfa_reset(GlobSet* set) {
+	if (set->state_table)
+		g_hash_table_destroy(set->state_table);
+	set->state_table = g_hash_table_new_full(hash_state, equal_state,
+			NULL, free_state);
+	g_ptr_array_set_size(set->states, 0);
+}
+
+
+static void dfa_start(GlobSet* set) {
+	guint32* positions = g_new0(guint32, set->width);
+	gint i;
+
+	for (i = 0; i < set->starts->len; i++)
+		POS_SET(positions, g_array_index(set->starts, gint, i));
+	dfa_closure(set, positions);
+	(void) dfa_state(set, positions, TRUE);
+}
+
+
+/* The index of the state for the given positions, which are taken over. */
+static gint dfa_state(GlobSet* set, guint32* positions, gboolean leading) {
+	struct dfa_state key;
+	struct dfa_state* state;
+	gint i;
+
+	key.positions = positions;
+	key.width = set->width;
+	key.leading = leading;
+	if ( (state = g_hash_table_lookup(set->state_table, &key)) != NULL) {
+		g_free(positions);
+		return state->index;
+	}
+
+	state = g_new(struct dfa_state, 1);
+	state->positions = positions;
+	state->width = set->width;
+	state->leading = leading;
+	state->dead = TRUE;
+	state->flags = 0;
+	for (i = 0; i < set->pos_node->len; i++) {
+		if (POS_IS_SET(positions, i)) {
+			state->dead = FALSE;
+			state->flags |= g_array_index(set->pos_flags, guint, i);
+		}
+	}
+	for (i = 0; i < G_N_ELEMENTS(state->next); i++)
+		state->next[i] = -1;
+
+	state->index = set->states->len;
+	g_ptr_array_add(set->states, state);
+	g_hash_table_insert(set->state_table, state, state);
+
+	return state->index;
+}
+
+
+/* Where the NFA can be after reading c in the given state.  As with
+   fnmatch()'s FNM_PERIOD, a leading period has to be matched by a literal
+   period at the start of the pattern. */
+static guint32* dfa_step(GlobSet* set, const struct dfa_state* state,
+		guchar c) {
+	guint32* positions = g_new0(guint32, set->width);
+	const struct node* node;
+	gint i;
+
+	if (state->leading && c == '.') {
+		for (i = 0; i < set->starts->len; i++) {
+			gint start = g_array_index(set->starts, gint, i);
+			node = g_ptr_array_index(set->pos_node, start);
+			if (node && node->type == N_CHAR && node->c == '.')
+				POS_SET(positions, start + 1);
+		}
+		dfa_closure(set, positions);
+		return positions;
+	}
+
+	for (i = 0; i < set->pos_node->len; i++) {
+		if (!POS_IS_SET(state->positions, i))
+			continue;
+		if ( (node = g_ptr_array_index(set->pos_node, i)) == NULL)
+			continue;
+
+		switch (node->type) {
+			case N_CHAR:
+				if (node->c == c)
+					POS_SET(positions, i + 1);
+				break;
+			case N_ANY:
+				POS_SET(positions, i + 1);
+				break;
+			case N_CLASS:
+				if (node->set[c / 32] & (1U << (c % 32)))
+					POS_SET(positions, i + 1);
+				break;
+			case N_STAR:
+				POS_SET(positions, i);
+				break;
+			default:
+				break;
+		}
+	}
+
+	dfa_closure(set, positions);
+	return positions;
+}
+
+
+/* A '*' can also match nothing.  Stars are never next to each other, so one
+   pass forward is enough. */
+static void dfa_closure(GlobSet* set, guint32* positions) {
+	const struct node* node;
+	gint i;
+
+	for (i = 0; i < set->pos_node->len; i++) {
+		node = g_ptr_array_index(set->pos_node, i);
+		if (node && node->type == N_STAR && POS_IS_SET(positions, i))
+			POS_SET(positions, i + 1);
+	}
+}
+
+
+static guint hash_state(gconstpointer key) {
+	const struct dfa_state* state = key;
+	guint hash = state->leading;
+	gint i;
+
+	for (i = 0; i < state->width; i++)
+		hash = hash * 31 + state->positions[i];
+	return hash;
+}
+
+
+static gboolean equal_state(gconstpointer a, gconstpointer b) {
+	const struct dfa_state* sa = a;
+	const struct dfa_state* sb = b;
+
+	return sa->leading == sb->leading &&
+		memcmp(sa->positions, sb->positions,
+				sa->width * sizeof(guint32)) == 0;
+}
+
+
+static void free_state(gpointer data) {
+	struct dfa_state* state = data;
+
+	g_free(state->positions);
+	g_free(state);
+}
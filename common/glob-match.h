@@ -0,0 +1,67 @@
+/*
+	Copyright (C) 2004, 2005 Stephen Bach
+	This file is part of the Viewglob package.
+
+	Viewglob is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Viewglob is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Viewglob; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef GLOB_MATCH_H
+#define GLOB_MATCH_H
+
+#include "common.h"
+#include "shell.h"
+
+G_BEGIN_DECLS
+
+
+/* Words are kept in "pattern form": quote removal has been done, and every
+   character that was quoted (other than '/') is preceded by a backslash, so
+   only the unescaped characters are special. */
+
+/* Brace expansion won't produce more words than this from a single word. */
+#define GLOB_MAX_WORDS 4096
+
+/* Lazily built DFA states a GlobSet keeps before starting over. */
+#define GLOB_SET_MAX_STATES 512
+
+/* Shell options glob_split() has to be told about. */
+#define GLOB_OPT_EXTGLOB 1  /* bash's extglob is on. */
+#define GLOB_OPT_FOREIGN 2  /* Something is on which changes what a glob
+                               matches in a way not done here (e.g. dotglob,
+                               nullglob or nocaseglob). */
+
+typedef struct _GlobPattern GlobPattern;
+typedef struct _GlobSet GlobSet;
+
+
+gchar**      glob_split(const gchar* cmd, enum shell_type shell,
+		guint options);
+void         glob_braces(GPtrArray* words, const gchar* word);
+gboolean     glob_has_magic(const gchar* pattern, gsize len);
+gchar*       glob_unescape(const gchar* pattern, gsize len);
+
+GlobPattern* glob_compile(const gchar* pattern, gsize len);
+gboolean     glob_match(const GlobPattern* gp, const gchar* name);
+void         glob_free(GlobPattern* gp);
+
+GlobSet*     glob_set_new(void);
+void         glob_set_add(GlobSet* set, const gchar* pattern, guint flags);
+guint        glob_set_match(GlobSet* set, const gchar* name);
+void         glob_set_free(GlobSet* set);
+
+
+G_END_DECLS
+
+#endif /* !GLOB_MATCH_H */
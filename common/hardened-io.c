@@ -200,3 +200,15 @@ int hardened_select(gint n, fd_set* readfds, long milliseconds) {
 	return result;
 }
 
+
+/* Whether fd has something to read right now. */
+gboolean data_waiting(gint fd) {
+	fd_set rset;
+
+	g_return_val_if_fail(fd >= 0, FALSE);
+
+	FD_ZERO(&rset);
+	FD_SET(fd, &rset);
+	return hardened_select(fd + 1, &rset, 0) > 0;
+}
+
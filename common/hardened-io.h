@@ -53,6 +53,7 @@ enum io_result writev_all(int fd, struct iovec* vec, int count);
 
 enum io_result hardened_read(gint fd, void* buf, size_t count, gssize* nread);
 int            hardened_select(gint fd, fd_set* readfds, long milliseconds);
+gboolean       data_waiting(gint fd);
 
 G_END_DECLS
 
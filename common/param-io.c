@@ -24,10 +24,10 @@
 #include <netinet/in.h>
 #include <string.h>
 
-/* On my busiest machine, the vgexpand output for /usr/bin, /usr/include, and
-   /usr/lib all at once is 85K.  So 100K should be a good max for now.
-   Probably in the future it would be better to have a growing buffer. */
-#define BUFFER_SIZE 102400
+/* The receive buffer grows to fit the largest parameter seen so far (the
+   vgexpand output for /usr/bin, /usr/include and /usr/lib alone is 85K).
+   Anything claiming to be bigger than this is taken to be garbage. */
+#define BUFFER_SIZE_MAX (64 * 1024 * 1024)
 
 /* Order must correspond to enum parameter type. */
 static gchar* params[P_COUNT] = {
@@ -36,6 +36,7 @@ static gchar* params[P_COUNT] = {
 	"version",
 	"term-title",
 	"vgexpand-opts",
+	"offer",
 	"status",
 	"pwd",
 	"cmd",
@@ -50,14 +51,44 @@ static gchar* params[P_COUNT] = {
 	"eof",      /* This one shouldn't be received as a string. */
 };
 
+/* The framing in use on each descriptor.  Everything starts out as text
+   until the peers agree otherwise. */
+static guint8 framing[FD_SETSIZE];
+
+static gchar* buf = NULL;
+static gsize buf_size = 0;
+
+static gboolean parse_text(gchar* data, guint32 bytes, enum parameter* param,
+		gchar** value, gsize* len);
+static gboolean parse_binary(gchar* data, guint32 bytes,
+		enum parameter* param, gchar** value, gsize* len);
+
+
+/* Switch the framing used for fd.  Both ends have to agree on this, which
+   is what PARAM_FRAMING_OFFER is for. */
+void param_io_set_framing(int fd, enum param_framing f) {
+
+	g_return_if_fail(fd >= 0 && fd < FD_SETSIZE);
+
+	framing[fd] = f;
+}
+
 
 gboolean get_param(int fd, enum parameter* param, gchar** value) {
+	return get_param_len(fd, param, value, NULL);
+}
+
 
-	g_return_val_if_fail(fd >= 0, FALSE);
+/* Read a parameter and its value.  The value is NUL terminated and stays
+   valid until the next call.  If len is given it's set to the length of the
+   value, which in binary framing may contain NULs. */
+gboolean get_param_len(int fd, enum parameter* param, gchar** value,
+		gsize* len) {
+
+	g_return_val_if_fail(fd >= 0 && fd < FD_SETSIZE, FALSE);
 	g_return_val_if_fail(param != NULL, FALSE);
 	g_return_val_if_fail(value != NULL, FALSE);
 
-	static gchar buf[BUFFER_SIZE];
 	guint32 bytes;
 
 	/* Find out how many bytes we're going to need to read. */
@@ -78,6 +109,17 @@ gboolean get_param(int fd, enum parameter* param, gchar** value) {
 			/*break;*/
 	}
 
+	if (bytes > BUFFER_SIZE_MAX) {
+		g_critical("Data length %u is too large", bytes);
+		return FALSE;
+	}
+
+	/* Make room for the data plus a terminating NUL. */
+	if (bytes + 1 > buf_size) {
+		buf_size = MAX(bytes + 1, buf_size * 2);
+		buf = g_realloc(buf, buf_size);
+	}
+
 	/* Get the whole parameter/value pair. */
 	switch (read_all(fd, buf, bytes)) {
 		case IOR_OK:
@@ -93,18 +135,42 @@ gboolean get_param(int fd, enum parameter* param, gchar** value) {
 			g_return_val_if_reached(FALSE);
 			/*break;*/
 	}
+	buf[bytes] = '\0';
+
+	if (framing[fd] == PF_BINARY) {
+		if (!parse_binary(buf, bytes, param, value, len))
+			goto fail;
+	}
+	else if (!parse_text(buf, bytes, param, value, len))
+		goto fail;
+	return TRUE;
+
+	eof_reached:
+	*param = P_EOF;
+	*value = "EOF received";
+	if (len)
+		*len = strlen(*value);
+	return TRUE;
+
+	fail:
+	g_critical("Data in incorrect format");
+	return FALSE;
+}
 
-	/* Now parse the data. */
+
+/* Text framing: "name:value\027\027". */
+static gboolean parse_text(gchar* data, guint32 bytes, enum parameter* param,
+		gchar** value, gsize* len) {
 	gchar* start;
 	gchar* end;
 	gchar* p = NULL;
 	gchar* v = NULL;
 
 	/* First the parameter name. */
-	start = buf;
-	end = g_strstr_len(buf, bytes, ":");
+	start = data;
+	end = g_strstr_len(data, bytes, ":");
 	if (!end)
-		goto fail;
+		return FALSE;
 	*end = '\0';
 	p = start;
 	bytes -= end - start + 1;
@@ -113,54 +179,95 @@ gboolean get_param(int fd, enum parameter* param, gchar** value) {
 	start = end + 1;
 	end = g_strstr_len(start, bytes, "\027\027");
 	if (!end)
-		goto fail;
+		return FALSE;
 	*end = '\0';
 	v = start;
-	bytes -= end - start + 2;
 
 	*param = string_to_param(p);
 	*value = v;
+	if (len)
+		*len = end - start;
 	return TRUE;
+}
 
-	eof_reached:
-	*param = P_EOF;
-	*value = "EOF received";
-	return TRUE;
 
-	fail:
-	g_critical("Data in incorrect format");
-	return FALSE;
+/* Binary framing: the parameter number as a single byte, followed by the
+   value.  The value's length is whatever's left of the frame. */
+static gboolean parse_binary(gchar* data, guint32 bytes,
+		enum parameter* param, gchar** value, gsize* len) {
+	guint8 p;
+
+	if (bytes < 1)
+		return FALSE;
+
+	p = (guint8) data[0];
+	*param = p < P_COUNT && p != P_EOF ? p : P_NONE;
+	*value = data + 1;
+	if (len)
+		*len = bytes - 1;
+	return TRUE;
 }
 
 
 gboolean put_param(int fd, enum parameter param, gchar* value) {
 
-	g_return_val_if_fail(fd >= 0, FALSE);
+	g_return_val_if_fail(value != NULL, FALSE);
+
+	return put_param_len(fd, param, value, strlen(value));
+}
+
+
+/* Send a parameter whose value is len bytes long.  The value is written
+   straight from the caller's buffer along with the frame header.  Only
+   binary framing can carry NULs (or "\027\027") in the value. */
+gboolean put_param_len(int fd, enum parameter param, const gchar* value,
+		gsize len) {
+
+	g_return_val_if_fail(fd >= 0 && fd < FD_SETSIZE, FALSE);
 	g_return_val_if_fail(param < P_COUNT, FALSE);
 	g_return_val_if_fail(value != NULL, FALSE);
 
-	gchar* string;
+	struct iovec iov[5];
+	gint count;
 	guint32 bytes;
-	gsize len;
-
-	/* Make the string. */
-	string = g_strconcat(param_to_string(param), ":", value, "\027\027", NULL);
-	len = strlen(string);
+	guint8 p;
+	gchar* name;
+	gsize total;
+
+	if (framing[fd] == PF_BINARY) {
+		p = param;
+		iov[1].iov_base = &p;
+		iov[1].iov_len = sizeof(p);
+		iov[2].iov_base = (gchar*) value;
+		iov[2].iov_len = len;
+		count = 3;
+		total = sizeof(p) + len;
+	}
+	else {
+		name = param_to_string(param);
+		iov[1].iov_base = name;
+		iov[1].iov_len = strlen(name);
+		iov[2].iov_base = ":";
+		iov[2].iov_len = 1;
+		iov[3].iov_base = (gchar*) value;
+		iov[3].iov_len = len;
+		iov[4].iov_base = "\027\027";
+		iov[4].iov_len = 2;
+		count = 5;
+		total = iov[1].iov_len + 1 + len + 2;
+	}
 
 	/* Make sure the length is okay, and convert to network format. */
-	if (len > BUFFER_SIZE) {
-		g_critical("String length is greater than %u", BUFFER_SIZE);
+	if (total > BUFFER_SIZE_MAX) {
+		g_critical("Data length is greater than %u", BUFFER_SIZE_MAX);
 		return FALSE;
 	}
-	bytes = htonl((guint32)len);
-
-	/* Use writev() to try to avoid Nagle effect */
-	struct iovec iov[2];
+	bytes = htonl((guint32) total);
 	iov[0].iov_base = &bytes;
 	iov[0].iov_len = sizeof(bytes);
-	iov[1].iov_base = string;
-	iov[1].iov_len = len;
-	if (writev_all(fd, iov, 2) != IOR_OK) {
+
+	/* Use writev() to try to avoid Nagle effect */
+	if (writev_all(fd, iov, count) != IOR_OK) {
 		g_critical("Could not write parameter: %s", g_strerror(errno));
 		return FALSE;
 	}
@@ -36,6 +36,7 @@ enum parameter {
 	P_VERSION,
 	P_TERM_TITLE,
 	P_VGEXPAND_OPTS,
+	P_OFFER,
 
 	/* Volatile vgseer properties. */
 	P_STATUS,
@@ -67,8 +68,27 @@ enum parameter {
 	P_COUNT,
 };
 
+/* How parameters are framed on the wire.  Text framing is what every
+   version understands.  Once vgd has acknowledged vgseer's P_VERSION with
+   "OK" (the versions match, so it knows about P_OFFER), vgseer sends
+   P_OFFER listing PARAM_FRAMING_OFFER among its offers, and vgd replies
+   with P_OFFER listing the ones it accepts.  Both ends switch right after
+   that exchange.  An older vgd never sees P_OFFER. */
+enum param_framing {
+	PF_TEXT,
+	PF_BINARY,
+};
+
+#define PARAM_FRAMING_OFFER "binary-framing"
+
+void param_io_set_framing(int fd, enum param_framing f);
+
 gboolean get_param(int fd, enum parameter* param, gchar** value);
+gboolean get_param_len(int fd, enum parameter* param, gchar** value,
+		gsize* len);
 gboolean put_param(int fd, enum parameter param, gchar* value);
+gboolean put_param_len(int fd, enum parameter param, const gchar* value,
+		gsize len);
 enum parameter string_to_param(gchar* string);
 gchar* param_to_string(enum parameter param);
 
@@ -0,0 +1,252 @@
+/*
+	Copyright (C) 2004, 2005 Stephen Bach
+	This file is part of the Viewglob package.
+
+	Viewglob is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Viewglob is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Viewglob; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+/* Stat'ing the entries of a directory one after another costs a round trip
+   each on NFS or sshfs, so a big directory takes thousands of them in a
+   row.  Where the kernel has io_uring, the statx() calls are instead kept
+   STAT_RING_DEPTH at a time in flight, so the round trips overlap.  The
+   ring is driven through the system calls directly rather than through
+   liburing, to avoid the dependency.
+
+   If io_uring isn't there (not Linux, an old kernel, or a seccomp policy
+   that forbids it), stat_ring_modes() says so and the caller stats the
+   names itself. */
+
+#include "config.h"
+
+#include "common.h"
+#include "stat-ring.h"
+
+#if HAVE_LINUX_IO_URING_H
+#  include <linux/io_uring.h>
+#  include <linux/stat.h>
+#  include <sys/syscall.h>
+#  include <sys/mman.h>
+#  include <fcntl.h>
+#  include <string.h>
+#endif
+
+#if HAVE_LINUX_IO_URING_H && defined(__NR_io_uring_setup) && \
+	defined(__NR_io_uring_enter)
+
+struct ring {
+	gint fd;
+
+	guint* sq_head;
+	guint* sq_tail;
+	guint* sq_mask;
+	guint* sq_array;
+	struct io_uring_sqe* sqes;
+
+	guint* cq_head;
+	guint* cq_tail;
+	guint* cq_mask;
+	struct io_uring_cqe* cqes;
+
+	void* sq_ptr;
+	size_t sq_len;
+	void* cq_ptr;
+	size_t cq_len;
+	size_t sqes_len;
+};
+
+/* Set once io_uring has turned out not to work here. */
+static volatile gint ring_broken = FALSE;
+
+static gboolean ring_open(struct ring* r);
+static void     ring_close(struct ring* r);
+
+
+/* Look up the modes of the given names (relative to dir_fd, symlinks not
+   followed).  A name which can't be stat'ed gets a mode of 0.  Returns
+   FALSE if it couldn't be done this way. */
+gboolean stat_ring_modes(gint dir_fd, gchar** names, guint count,
+		mode_t* modes) {
+
+	g_return_val_if_fail(names != NULL, FALSE);
+	g_return_val_if_fail(modes != NULL, FALSE);
+
+	struct ring r;
+	struct statx* bufs;
+	guint which[STAT_RING_DEPTH];   /* Name each slot is stat'ing. */
+	guint free_slots[STAT_RING_DEPTH];
+	guint n_free = STAT_RING_DEPTH;
+	guint next = 0, done = 0;
+	guint tail, head, slot, i;
+	gboolean unsupported = FALSE;
+	struct io_uring_sqe* sqe;
+	struct io_uring_cqe* cqe;
+
+	if (ring_broken)
+		return FALSE;
+	if (!ring_open(&r)) {
+		ring_broken = TRUE;
+		return FALSE;
+	}
+
+	bufs = g_new(struct statx, STAT_RING_DEPTH);
+	for (i = 0; i < STAT_RING_DEPTH; i++)
+		free_slots[i] = i;
+
+	while (done < count) {
+
+		/* Queue up as many as there are free slots. */
+		tail = *r.sq_tail;
+		while (next < count && n_free > 0) {
+			slot = free_slots[--n_free];
+			which[slot] = next;
+
+			sqe = &r.sqes[tail & *r.sq_mask];
+			memset(sqe, 0, sizeof(*sqe));
+			sqe->opcode = IORING_OP_STATX;
+			sqe->fd = dir_fd;
+			sqe->addr = (guint64) (gulong) names[next];
+			sqe->len = STATX_TYPE | STATX_MODE;
+			sqe->off = (guint64) (gulong) &bufs[slot];
+			sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+			sqe->user_data = slot;
+			r.sq_array[tail & *r.sq_mask] = tail & *r.sq_mask;
+
+			tail++;
+			next++;
+		}
+		__atomic_store_n(r.sq_tail, tail, __ATOMIC_RELEASE);
+
+		/* Submit whatever the kernel hasn't taken yet and wait for at
+		   least one to finish. */
+		if (syscall(__NR_io_uring_enter, r.fd,
+					tail - __atomic_load_n(r.sq_head, __ATOMIC_ACQUIRE),
+					1, IORING_ENTER_GETEVENTS, NULL, 0) == -1 &&
+				errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+			/* Requests may still be in flight, and they'd write into
+			   bufs, so it can't be freed. */
+			ring_broken = TRUE;
+			ring_close(&r);
+			return FALSE;
+		}
+
+		head = *r.cq_head;
+		while (head != __atomic_load_n(r.cq_tail, __ATOMIC_ACQUIRE)) {
+			cqe = &r.cqes[head & *r.cq_mask];
+			slot = cqe->user_data;
+
+			if (cqe->res == 0)
+				modes[which[slot]] = bufs[slot].stx_mode;
+			else {
+				modes[which[slot]] = 0;
+				/* A kernel with io_uring but without statx in it. */
+				if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP)
+					unsupported = TRUE;
+			}
+
+			free_slots[n_free++] = slot;
+			head++;
+			done++;
+		}
+		__atomic_store_n(r.cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	ring_close(&r);
+	g_free(bufs);
+
+	if (unsupported) {
+		ring_broken = TRUE;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+
+static gboolean ring_open(struct ring* r) {
+	struct io_uring_params p;
+	gchar* sq;
+	gchar* cq;
+
+	memset(&p, 0, sizeof(p));
+	r->fd = syscall(__NR_io_uring_setup, STAT_RING_DEPTH, &p);
+	if (r->fd == -1)
+		return FALSE;
+
+	r->sq_len = p.sq_off.array + p.sq_entries * sizeof(guint);
+	r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->sq_len = r->cq_len = MAX(r->sq_len, r->cq_len);
+	r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->cq_ptr = r->sqes = MAP_FAILED;
+
+	r->sq_ptr = mmap(NULL, r->sq_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ptr == MAP_FAILED)
+		goto fail;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->cq_ptr = r->sq_ptr;
+	else {
+		r->cq_ptr = mmap(NULL, r->cq_len, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_ptr == MAP_FAILED)
+			goto fail;
+	}
+
+	r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		goto fail;
+
+	sq = r->sq_ptr;
+	r->sq_head = (guint*) (sq + p.sq_off.head);
+	r->sq_tail = (guint*) (sq + p.sq_off.tail);
+	r->sq_mask = (guint*) (sq + p.sq_off.ring_mask);
+	r->sq_array = (guint*) (sq + p.sq_off.array);
+
+	cq = r->cq_ptr;
+	r->cq_head = (guint*) (cq + p.cq_off.head);
+	r->cq_tail = (guint*) (cq + p.cq_off.tail);
+	r->cq_mask = (guint*) (cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+
+	return TRUE;
+
+fail:
+	ring_close(r);
+	return FALSE;
+}
+
+
+static void ring_close(struct ring* r) {
+	if (r->sqes != MAP_FAILED)
+		(void) munmap(r->sqes, r->sqes_len);
+	if (r->cq_ptr != MAP_FAILED && r->cq_ptr != r->sq_ptr)
+		(void) munmap(r->cq_ptr, r->cq_len);
+	if (r->sq_ptr != MAP_FAILED)
+		(void) munmap(r->sq_ptr, r->sq_len);
+	(void) close(r->fd);
+}
+
+
+#else
+
+
+gboolean stat_ring_modes(gint dir_fd, gchar** names, guint count,
+		mode_t* modes) {
+	return FALSE;
+}
+
+
+#endif
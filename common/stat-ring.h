@@ -0,0 +1,42 @@
+/*
+	Copyright (C) 2004, 2005 Stephen Bach
+	This file is part of the Viewglob package.
+
+	Viewglob is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Viewglob is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Viewglob; if not, write to the Free Software
+	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef STAT_RING_H
+#define STAT_RING_H
+
+#include "common.h"
+#include <sys/stat.h>
+
+G_BEGIN_DECLS
+
+
+/* Fewer names than this aren't worth setting up a ring for. */
+#define STAT_RING_MIN 16
+
+/* Requests kept in flight at once. */
+#define STAT_RING_DEPTH 64
+
+
+gboolean stat_ring_modes(gint dir_fd, gchar** names, guint count,
+		mode_t* modes);
+
+
+G_END_DECLS
+
+#endif /* !STAT_RING_H */
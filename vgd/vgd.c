@@ -35,6 +35,7 @@
 #include "common.h"
 #include "hardened-io.h"
 #include "param-io.h"
+#include "expand.h"
 #include "child.h"
 #include "x11-stuff.h"
 #include "shell.h"
@@ -83,6 +84,10 @@ struct vgseer_client {
 	GString*          developing_mask;
 	GString*          mask;
 	GString*          expanded;
+	GString*          rebuilt;           /* Scratch for applying deltas. */
+	guint32           generation;        /* Results received so far. */
+	gboolean          awaiting_full;     /* Asked for full results. */
+	gboolean          display_stale;     /* Results not yet shown. */
 };
 
 
@@ -101,6 +106,9 @@ static void context_switch(struct state* s, struct vgseer_client* v);
 static void check_active_window(struct state* s);
 static void update_display(struct state* s, struct vgseer_client* v,
 		enum parameter param, gchar* value);
+static void update_display_len(struct state* s, struct vgseer_client* v,
+		enum parameter param, gchar* value, gsize len);
+static gboolean fork_display(struct state* s);
 static gint unix_listen(struct state* s);
 static int daemonize(void);
 static void parse_args(gint argc, gchar** argv, struct state* s);
@@ -520,7 +528,8 @@ static void context_switch(struct state* s, struct vgseer_client* v) {
 			!put_param(fd, P_DEVELOPING_MASK, v->developing_mask->str) ||
 			!put_param(fd, P_MASK, v->mask->str) ||
 			!put_param(fd, P_WIN_ID, win_to_str(v->win)) ||
-			!put_param(fd, P_VGEXPAND_DATA, v->expanded->str)) {
+			!put_param_len(fd, P_VGEXPAND_DATA, v->expanded->str,
+				v->expanded->len)) {
 		g_critical("(disp) Couldn't make context switch");
 		// FIXME restart display, try again
 	}
@@ -536,7 +545,7 @@ static void process_display(struct state* s) {
 	/* Try to recover from display read errors instead of just dying. */
 	if (!get_param(s->display.fd_in, &param, &value)) {
 		(void) child_terminate(&s->display);
-		if (!child_fork(&s->display)) {
+		if (!fork_display(s)) {
 			g_critical("The display had issues and I couldn't restart it");
 			die(s, GENERAL_FAILURE);
 		}
@@ -594,8 +603,10 @@ static void process_client(struct state* s, struct vgseer_client* v) {
 
 	enum parameter param;
 	gchar* value;
+	gsize len;
+	GString* swap;
 
-	if (!get_param(v->fd, &param, &value)) {
+	if (!get_param_len(v->fd, &param, &value, &len)) {
 		drop_client(s, v);
 		return;
 	}
@@ -609,6 +620,7 @@ static void process_client(struct state* s, struct vgseer_client* v) {
 				g_warning("(%d) Invalid shell status from client: %s",
 						v->fd, value);
 				drop_client(s, v);
+				return;
 			}
 
 			if (new_status != v->status) {
@@ -657,7 +669,7 @@ static void process_client(struct state* s, struct vgseer_client* v) {
 				if (child_running(&s->display))
 					child_terminate(&s->display);
 				else {
-					if (!child_fork(&s->display)) {
+					if (!fork_display(s)) {
 						g_critical("Couldn't fork the display");
 						die(s, GENERAL_FAILURE);
 					}
@@ -671,26 +683,75 @@ static void process_client(struct state* s, struct vgseer_client* v) {
 			break;
 
 		case P_VGEXPAND_DATA:
-			v->expanded = g_string_assign(v->expanded, value);
-			update_display(s, v, param, value);
+			/* Binary from current vgseers, text from older ones, or a delta
+			   against the last results.  The display always gets the full
+			   results. */
+			v->generation++;
+			if (len > 0 && *value == EXPAND_DELTA_MAGIC) {
+				if (!expand_delta_apply(v->rebuilt, v->expanded,
+							v->generation - 1, value, len)) {
+					/* Lost track; get vgseer to start over. */
+					v->expanded = g_string_truncate(v->expanded, 0);
+					if (!v->awaiting_full) {
+						g_warning("(%d) Couldn't apply expansion delta", v->fd);
+						(void) put_param(v->fd, P_ORDER, "full-expansion");
+						v->awaiting_full = TRUE;
+					}
+					break;
+				}
+				swap = v->expanded;
+				v->expanded = v->rebuilt;
+				v->rebuilt = swap;
+			}
+			else {
+				v->expanded = g_string_truncate(v->expanded, 0);
+				v->expanded = g_string_append_len(v->expanded, value, len);
+				v->awaiting_full = FALSE;
+			}
+
+			/* When typing outpaces the display, more results are often
+			   already queued behind these; only the last of them is worth
+			   drawing. */
+			if (data_waiting(v->fd))
+				v->display_stale = TRUE;
+			else {
+				v->display_stale = FALSE;
+				update_display_len(s, v, param, v->expanded->str,
+						v->expanded->len);
+			}
 			break;
 
 		case P_EOF:
 			g_message("(%d) EOF from client", v->fd);
 			drop_client(s, v);
-			break;
+			return;
 
 		default:
 			g_warning("(%d) Unexpected parameter: %d = %s", v->fd, param,
 					value);
 			drop_client(s, v);
-			break;
+			return;
+	}
+
+	/* Whatever was waiting turned out not to be more results. */
+	if (v->display_stale && !data_waiting(v->fd)) {
+		v->display_stale = FALSE;
+		update_display_len(s, v, P_VGEXPAND_DATA, v->expanded->str,
+				v->expanded->len);
 	}
 }
 
 
 static void update_display(struct state* s, struct vgseer_client* v,
 		enum parameter param, gchar* value) {
+	g_return_if_fail(value != NULL);
+
+	update_display_len(s, v, param, value, strlen(value));
+}
+
+
+static void update_display_len(struct state* s, struct vgseer_client* v,
+		enum parameter param, gchar* value, gsize len) {
 	g_return_if_fail(s != NULL);
 	g_return_if_fail(v != NULL);
 	g_return_if_fail(value != NULL);
@@ -698,13 +759,27 @@ static void update_display(struct state* s, struct vgseer_client* v,
 	if (s->current != v || !child_running(&s->display))
 		return;
 
-	if (!put_param(s->display.fd_out, param, value)) {
+	if (!put_param_len(s->display.fd_out, param, value, len)) {
 		g_critical("Couldn't send parameter to display");
 		//FIXME restart display
 	}
 }
 
 
+/* Start the display.  It always comes from the same installation as vgd,
+   so the pipes can go straight to binary framing. */
+static gboolean fork_display(struct state* s) {
+	g_return_val_if_fail(s != NULL, FALSE);
+
+	if (!child_fork(&s->display))
+		return FALSE;
+
+	param_io_set_framing(s->display.fd_in, PF_BINARY);
+	param_io_set_framing(s->display.fd_out, PF_BINARY);
+	return TRUE;
+}
+
+
 /* Disconnect the client and free its resources. */
 static void drop_client(struct state* s, struct vgseer_client* v) {
 	g_return_if_fail(s != NULL);
@@ -719,6 +794,7 @@ static void drop_client(struct state* s, struct vgseer_client* v) {
 	g_string_free(v->developing_mask, TRUE);
 	g_string_free(v->mask, TRUE);
 	g_string_free(v->expanded, TRUE);
+	g_string_free(v->rebuilt, TRUE);
 	g_free(v);
 
 	/* Kill the display if all the clients are gone. */
@@ -772,6 +848,10 @@ static void new_client(struct state* s, gint accept_fd) {
 
 	g_message("(%d) New client accepted", new_fd);
 
+	/* The descriptor may have belonged to a client that used binary
+	   framing. */
+	param_io_set_framing(new_fd, PF_TEXT);
+
 	// TODO add time limits to get_param
 	/* Receive client's purpose. */
 	if (get_param(new_fd, &param, &value) && param == P_PURPOSE) {
@@ -811,6 +891,10 @@ static void new_vgseer_client(struct state* s, gint client_fd) {
 
 	struct vgseer_client* v;
 	gchar* term_title = NULL;
+	gchar** offers;
+	gchar** iter;
+	GString* accepted;
+	gboolean binary = FALSE;
 
 	g_message("(%d) Client is a vgseer", client_fd);
 
@@ -838,8 +922,38 @@ static void new_vgseer_client(struct state* s, gint client_fd) {
 		g_free(warning);
 	}
 
+	/* A vgseer of the same version may offer binary framing and expansion
+	   deltas before the title.  List the ones we accept. */
+	if (!get_param(client_fd, &param, &value))
+		goto out_of_sync;
+	if (param == P_OFFER) {
+		offers = g_strsplit(value, " ", 0);
+		accepted = g_string_new(NULL);
+		for (iter = offers; *iter; iter++) {
+			if (STREQ(*iter, PARAM_FRAMING_OFFER))
+				binary = TRUE;
+			else if (!STREQ(*iter, EXPAND_DELTA_OFFER))
+				continue;
+			if (accepted->len > 0)
+				accepted = g_string_append_c(accepted, ' ');
+			accepted = g_string_append(accepted, *iter);
+		}
+		g_strfreev(offers);
+
+		if (!put_param(client_fd, P_OFFER, accepted->str)) {
+			g_string_free(accepted, TRUE);
+			goto reject;
+		}
+		g_string_free(accepted, TRUE);
+		if (binary)
+			param_io_set_framing(client_fd, PF_BINARY);
+
+		if (!get_param(client_fd, &param, &value))
+			goto out_of_sync;
+	}
+
 	/* Title */
-	if (!get_param(client_fd, &param, &value) || param != P_TERM_TITLE)
+	if (param != P_TERM_TITLE)
 		goto out_of_sync;
 	term_title = g_strdup(value);
 	
@@ -869,7 +983,7 @@ static void new_vgseer_client(struct state* s, gint client_fd) {
 
 	/* Startup the display if it's not around. */
 	if (!child_running(&s->display)) {
-		if (!child_fork(&s->display)) {
+		if (!fork_display(s)) {
 			g_critical("Couldn't fork the display");
 			die(s, GENERAL_FAILURE);
 		}
@@ -1023,5 +1137,9 @@ void vgseer_client_init(struct vgseer_client* v) {
 	v->developing_mask = g_string_new(NULL);
 	v->mask = g_string_new(NULL);
 	v->expanded = g_string_new(NULL);
+	v->rebuilt = g_string_new(NULL);
+	v->generation = 0;
+	v->awaiting_full = FALSE;
+	v->display_stale = FALSE;
 }
 
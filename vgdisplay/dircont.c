@@ -20,6 +20,7 @@
 #include "common.h"
 #include "file_box.h"
 #include "param-io.h"
+#include "expand.h"
 #include "dircont.h"
 #include <gtk/gtk.h>
 #include <string.h>   /* For strcmp */
@@ -254,14 +255,12 @@ void dircont_scroll_to_changed(DirCont* dc) {
 	g_return_if_fail(dc != NULL);
 	g_return_if_fail(IS_DIRCONT(dc));
 
-	FileBox* fb = FILE_BOX(dc->file_box);
+	gint y = file_box_get_changed_y(FILE_BOX(dc->file_box));
 
-	if (fb->changed_fi) {
+	if (y >= 0) {
 
 		gdouble page_inc, pos;
 
-		gint y = fb->changed_fi->widget->allocation.y;
-
 		GtkAdjustment* vadj= gtk_scrolled_window_get_vadjustment(
 				GTK_SCROLLED_WINDOW(dc->scrolled_window));
 
@@ -468,6 +467,11 @@ static void reset_count_layout(DirCont* dc) {
 				"(Restricted)",
 				count_tag_close->str, NULL);
 	}
+	else if (STREQ(dc->total->str, EXPAND_INCOMPLETE_COUNT)) {
+		markup = g_strconcat(count_tag_open->str,
+				"(Reading...)",
+				count_tag_close->str, NULL);
+	}
 	else {
 		markup = g_strconcat(count_tag_open->str, "<b>",
 				dc->selected->str, " selected, ",
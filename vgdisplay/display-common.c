@@ -33,6 +33,10 @@
 #include "fgetopt.h"
 
 static void report_version(void);
+static gboolean read_text(struct glob_reader* r, struct glob_record* rec);
+static gboolean read_binary(struct glob_reader* r, struct glob_record* rec);
+static gboolean read_name(struct glob_reader* r, gchar** name);
+static gboolean read_count(struct glob_reader* r, gchar* count);
 
 
 void prefs_init(struct prefs* v) {
@@ -242,6 +246,156 @@ void raise_wrapped(GtkWidget* display_win_gtk, gchar* term_win_str) {
 }
 
 
+/* Get ready to read the results in buf, which may be modified. */
+void glob_reader_init(struct glob_reader* r, gchar* buf, gsize bytes) {
+	g_return_if_fail(r != NULL);
+	g_return_if_fail(buf != NULL);
+
+	r->p = buf;
+	r->end = buf + bytes;
+	r->binary = bytes > 0 && *buf == EXPAND_DATA_MAGIC;
+	if (r->binary)
+		r->p++;
+}
+
+
+/* Read the next directory or file into rec.  Returns FALSE at the end of
+   the results. */
+gboolean glob_reader_next(struct glob_reader* r, struct glob_record* rec) {
+	g_return_val_if_fail(r != NULL, FALSE);
+	g_return_val_if_fail(rec != NULL, FALSE);
+
+	if (r->p >= r->end)
+		return FALSE;
+	else if (r->binary)
+		return read_binary(r, rec);
+	else
+		return read_text(r, rec);
+}
+
+
+/* The text format, from vgseers older than the binary format.  This is
+   trusting, as the old state machine was. */
+static gboolean read_text(struct glob_reader* r, struct glob_record* rec) {
+	gchar* string;
+
+	switch (*r->p) {
+		case '\n':
+			/* End of the results. */
+			r->p = r->end;
+			return FALSE;
+
+		case '\t':
+			r->p++;
+			rec->type = ER_FILE;
+			string = up_to_delimiter(&r->p, ' ');
+			rec->selection = map_selection_state(*string);
+			string = up_to_delimiter(&r->p, ' ');
+			rec->file_type = map_file_type(*string);
+			rec->name = up_to_delimiter(&r->p, '\n');
+			return TRUE;
+
+		default:
+			rec->type = ER_DIR;
+			rec->selected = up_to_delimiter(&r->p, ' ');
+			rec->total = up_to_delimiter(&r->p, ' ');
+			rec->hidden = up_to_delimiter(&r->p, ' ');
+			rec->name = up_to_delimiter(&r->p, '\n');
+			return TRUE;
+	}
+}
+
+
+static gboolean read_binary(struct glob_reader* r, struct glob_record* rec) {
+	guint8 selection;
+	guint8 type;
+
+	switch (*r->p++) {
+		case ER_DIR:
+			rec->type = ER_DIR;
+			if (!read_count(r, r->selected) || !read_count(r, r->total) ||
+					!read_count(r, r->hidden) || !read_name(r, &rec->name))
+				goto truncated;
+			rec->selected = r->selected;
+			rec->total = r->total;
+			rec->hidden = r->hidden;
+			return TRUE;
+
+		case ER_INCOMPLETE:
+			/* Shown as a directory with unknown counts, as in the text
+			   format. */
+			rec->type = ER_DIR;
+			if (!read_count(r, r->selected) || !read_count(r, r->total) ||
+					!read_count(r, r->hidden) || !read_name(r, &rec->name))
+				goto truncated;
+			g_strlcpy(r->selected, EXPAND_INCOMPLETE_COUNT, sizeof(r->selected));
+			g_strlcpy(r->total, EXPAND_INCOMPLETE_COUNT, sizeof(r->total));
+			g_strlcpy(r->hidden, EXPAND_INCOMPLETE_COUNT, sizeof(r->hidden));
+			rec->selected = r->selected;
+			rec->total = r->total;
+			rec->hidden = r->hidden;
+			return TRUE;
+
+		case ER_FILE:
+			rec->type = ER_FILE;
+			if (r->end - r->p < 2)
+				goto truncated;
+			selection = *r->p++;
+			type = *r->p++;
+			if (selection >= FS_COUNT || type >= FT_COUNT) {
+				g_warning("Unexpected file state in glob data");
+				r->p = r->end;
+				return FALSE;
+			}
+			rec->selection = selection;
+			rec->file_type = type;
+			if (!read_name(r, &rec->name))
+				goto truncated;
+			return TRUE;
+
+		default:
+			g_warning("Unexpected record in glob data");
+			r->p = r->end;
+			return FALSE;
+	}
+
+	truncated:
+	g_warning("Glob data is truncated");
+	r->p = r->end;
+	return FALSE;
+}
+
+
+static gboolean read_name(struct glob_reader* r, gchar** name) {
+	guint16 len;
+
+	if (r->end - r->p < sizeof(len))
+		return FALSE;
+	memcpy(&len, r->p, sizeof(len));
+	len = g_ntohs(len);
+	r->p += sizeof(len);
+
+	/* The name is followed by a NUL. */
+	if (r->end - r->p < len + 1 || r->p[len] != '\0')
+		return FALSE;
+	*name = r->p;
+	r->p += len + 1;
+	return TRUE;
+}
+
+
+static gboolean read_count(struct glob_reader* r, gchar* count) {
+	guint32 n;
+
+	if (r->end - r->p < sizeof(n))
+		return FALSE;
+	memcpy(&n, r->p, sizeof(n));
+	r->p += sizeof(n);
+	g_snprintf(count, sizeof(r->selected), "%u", g_ntohl(n));
+	return TRUE;
+}
+
+
 gchar* up_to_delimiter(gchar** ptr, char c) {
 	gchar* start = *ptr;
 	while (**ptr != c)
@@ -23,21 +23,37 @@
 
 #include "common.h"
 #include "file-types.h"
+#include "expand.h"
 #include <gtk/gtk.h>
 
 G_BEGIN_DECLS
 
-enum glob_read_state {
-	GRS_DONE,
-	GRS_CMD,
-	GRS_SELECTED_COUNT, 
-	GRS_FILE_COUNT,
-	GRS_HIDDEN_COUNT,
-	GRS_DIR_NAME,
-	GRS_IN_LIMBO,     /* Either input ends or another file or dir follows. */
-	GRS_FILE_STATE,
-	GRS_FILE_TYPE,
-	GRS_FILE_NAME,
+/* Walks through vgexpand results, in either format (see expand.h). */
+struct glob_reader {
+	gchar* p;
+	gchar* end;
+	gboolean binary;
+
+	/* The binary format has numeric counts; they're printed here. */
+	gchar selected[12];
+	gchar total[12];
+	gchar hidden[12];
+};
+
+/* A directory or file from the results.  The strings point into the
+   buffer being read or into the reader. */
+struct glob_record {
+	enum expand_record type;
+	gchar* name;
+
+	/* ER_DIR */
+	gchar* selected;
+	gchar* total;
+	gchar* hidden;
+
+	/* ER_FILE */
+	FileSelection selection;
+	FileType file_type;
 };
 
 
@@ -52,6 +68,8 @@ struct prefs {
 void set_icons(void);
 void write_xwindow_id(GtkWidget* gtk_window);
 gchar* up_to_delimiter(gchar** ptr, char c);
+void glob_reader_init(struct glob_reader* r, gchar* buf, gsize bytes);
+gboolean glob_reader_next(struct glob_reader* r, struct glob_record* rec);
 FileSelection map_selection_state(gchar c);
 FileType map_file_type(gchar c);
 gboolean window_key_press_event(GtkWidget* window, GdkEventKey* event,
@@ -20,6 +20,7 @@
 #include "common.h"
 #include "file_box.h"
 #include "param-io.h"
+#include "expand.h"
 #include "dlisting.h"
 #include <gtk/gtk.h>
 #include <string.h>   /* For strcmp */
@@ -326,6 +327,8 @@ static void reset_file_count_label(DListing* dl) {
 
 	if (STREQ(dl->total_count->str, "0"))
 		temp_string = g_strdup("(Restricted)");
+	else if (STREQ(dl->total_count->str, EXPAND_INCOMPLETE_COUNT))
+		temp_string = g_strdup("(Reading...)");
 	else {
 		temp_string = g_strconcat(
 				dl->selected_count->str, " selected, ",
@@ -25,10 +25,18 @@
 #include "wrap_box.h"
 #include "lscolors.h"
 #include <gtk/gtk.h>
-#include <string.h>      /* For strcmp */
+#include <string.h>      /* For memmove */
 
 #define BASE_FONT_SIZE 0
 
+/* Number of FItems past which a FileBox draws them itself rather than making
+   widgets for them. */
+#define DEFAULT_DISPLAY_LIMIT 1000
+
+/* Padding around the icon and label, matching fitem_build_widgets(). */
+#define ICON_XPAD  1
+#define LABEL_XPAD 1
+
 /* --- properties --- */
 enum {
   PROP_0,
@@ -46,23 +54,44 @@ static void  file_box_init(FileBox* fbox);
 
 static void   file_box_size_request(GtkWidget* widget,
 		GtkRequisition* requisition);
-static guint  file_box_get_display_pos(FileBox* fbox, FItem* fitem);
+static void   file_box_size_allocate(GtkWidget* widget,
+		GtkAllocation* allocation);
+static void   file_box_realize(GtkWidget* widget);
+static void   file_box_unrealize(GtkWidget* widget);
+static void   file_box_map(GtkWidget* widget);
+static void   file_box_unmap(GtkWidget* widget);
+static gint   file_box_expose_event(GtkWidget* widget,
+		GdkEventExpose* event);
+static gint   file_box_button_press_event(GtkWidget* widget,
+		GdkEventButton* event);
+static guint  file_box_insert_fitem(FileBox* fbox, FItem* fi, gint rank);
+static void   file_box_remove_fitem(FileBox* fbox, FItem* fi);
 static void   allow_size_requests(FileBox* fbox, gboolean allow);
+static void   file_box_set_virtual(FileBox* fbox, gboolean setting);
+
+static void   virtual_layout(FileBox* fbox, guint width,
+		GtkRequisition* requisition);
+static guint  virtual_columns_width(FileBox* fbox, guint rows, guint limit);
+static void   virtual_draw(FileBox* fbox, GdkRectangle* area);
+static FItem* virtual_hit(FileBox* fbox, gint x, gint y);
 
 static FItem*    fitem_new(const gchar* name, FileType type,
 		FileSelection selection);
 static void      fitem_build_widgets(FItem* fi);
 static void      fitem_free(FItem* fi, gboolean destroy_widgets);
+static GdkColor* fitem_set_layout(FItem* fi, PangoLayout* layout);
+static void      fitem_measure(FItem* fi, FileBox* fbox);
+static void      fitem_draw(FItem* fi, FileBox* fbox, gint x, gint y);
+static void      fitem_write_name(FItem* fi);
 static int       fitem_update_type_selection_and_order(FItem* fi, FileType t,
-		FileSelection s, FileBox* fbox, gint rank);
+		FileSelection s, FileBox* fbox);
 
-static gboolean size_request_kludge(GtkWidget* widget,
-		GtkRequisition* allocation, gpointer user_data);
+static void     style_set_event(GtkWidget* widget, GtkStyle* previous_style,
+		gpointer user_data);
 static gboolean fitem_button_press_event(GtkWidget* widget,
 		GdkEventButton* event, FItem* fi);
 
 static GtkStateType selection_to_state(FileSelection s);
-static gint cmp_same_name(gconstpointer a, gconstpointer b);
 
 static void initialize_icons(gchar* test_string);
 static GdkPixbuf*  make_pixbuf_scaled(const guint8 icon_inline[],
@@ -75,6 +104,10 @@ static gpointer parent_class = NULL;
 static GdkPixbuf* file_type_icons[FT_COUNT] =
 	{ NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL };
 
+/* Bumped whenever the icons or fonts change, so virtual FileBoxes know to
+   remeasure their FItems. */
+static guint sizing_serial = 1;
+
 /* --- functions --- */
 GType file_box_get_type(void) {
 	static GType file_box_type = 0;
@@ -109,6 +142,13 @@ static void file_box_class_init(FileBoxClass* class) {
 
 	parent_class = g_type_class_peek_parent(class);
 	widget_class->size_request = file_box_size_request;
+	widget_class->size_allocate = file_box_size_allocate;
+	widget_class->realize = file_box_realize;
+	widget_class->unrealize = file_box_unrealize;
+	widget_class->map = file_box_map;
+	widget_class->unmap = file_box_unmap;
+	widget_class->expose_event = file_box_expose_event;
+	widget_class->button_press_event = file_box_button_press_event;
 
 	/*
 	g_object_class_install_property (object_class,
@@ -124,29 +164,33 @@ static void file_box_class_init(FileBoxClass* class) {
 }
 
 
-/* This function prevents the size-request signal from propagating if
-   eat_size_requests == TRUE.  It would be better to make FItem a new class
-   which reimplements gtk_widget_show and prevents the size request from
-   happening in the first place. */
-static gboolean size_request_kludge(GtkWidget* widget,
-		GtkRequisition* requisition, gpointer user_data) {
+/* The font has changed, so the FItems will have to be measured again. */
+static void style_set_event(GtkWidget* widget, GtkStyle* previous_style,
+		gpointer user_data) {
 	FileBox* fbox = FILE_BOX(widget);
-	return fbox->eat_size_requests;
+
+	if (fbox->layout)
+		pango_layout_context_changed(fbox->layout);
+	fbox->measure_serial = 0;
 }
 
 
+/* Between file_box_begin_read() and file_box_flush() the WrapBox is frozen,
+   so the whole read costs one size negotiation. */
 static void allow_size_requests(FileBox* fbox, gboolean allow) {
 
-	if (fbox->eat_size_requests != allow)
+	if (fbox->frozen != allow)
 		return;
 
 	if (allow) {
 		/* Now we do a size request. */
-		fbox->eat_size_requests = FALSE;
-		gtk_widget_queue_resize(GTK_WIDGET(fbox));
+		fbox->frozen = FALSE;
+		wrap_box_thaw(WRAP_BOX(fbox));
+	}
+	else {
+		fbox->frozen = TRUE;
+		wrap_box_freeze(WRAP_BOX(fbox));
 	}
-	else
-		fbox->eat_size_requests = TRUE;
 }
 
 
@@ -154,12 +198,21 @@ static void file_box_init(FileBox *fbox) {
 	GTK_WIDGET_SET_FLAGS (fbox, GTK_NO_WINDOW);
 
 	fbox->optimal_width = 0;
-	fbox->fis = NULL;
-	fbox->eat_size_requests = FALSE;
+	fbox->fis = g_ptr_array_new();
+	fbox->fi_table = g_hash_table_new(g_str_hash, g_str_equal);
+	fbox->frozen = FALSE;
 	fbox->changed_fi = NULL;
+	fbox->file_display_limit = DEFAULT_DISPLAY_LIMIT;
 
-	g_signal_connect(fbox, "size-request", G_CALLBACK(size_request_kludge),
-			NULL);
+	fbox->virtual = FALSE;
+	fbox->event_window = NULL;
+	fbox->layout = NULL;
+	fbox->measure_serial = 0;
+	fbox->rows = 0;
+	fbox->row_height = 0;
+	fbox->col_x = g_array_new(FALSE, FALSE, sizeof(gint));
+
+	g_signal_connect(fbox, "style-set", G_CALLBACK(style_set_event), NULL);
 }
 
 
@@ -170,8 +223,12 @@ GtkWidget* file_box_new (void) {
 
 void file_box_destroy(FileBox* fbox) {
 
-	g_slist_foreach(fbox->fis, (GFunc) fitem_free, (gpointer) TRUE);
-	g_slist_free(fbox->fis);
+	g_hash_table_destroy(fbox->fi_table);
+	g_ptr_array_foreach(fbox->fis, (GFunc) fitem_free, (gpointer) TRUE);
+	g_ptr_array_free(fbox->fis, TRUE);
+	g_array_free(fbox->col_x, TRUE);
+	if (fbox->layout)
+		g_object_unref(fbox->layout);
 	gtk_widget_destroy(GTK_WIDGET(fbox));
 }
 
@@ -269,6 +326,8 @@ void file_box_set_sizing(gint modifier, gboolean use_icons) {
 	/* Parse LS_COLORS. */
 	parse_ls_colors(font_size_modifier);
 
+	sizing_serial++;
+
 	g_string_free(test_string, TRUE);
 }
 
@@ -441,67 +500,96 @@ int file_box_add(FileBox* fbox, gchar* name, FileType type,
 		FileSelection selection, gint rank) {
 	g_return_val_if_fail(IS_FILE_BOX(fbox), 0);
 
-	GSList* search_result;
 	FItem* fi;
 	gint points;
+	guint pos = 0;
 
 	/* Check if we've already got this FItem. */
-	search_result = g_slist_find_custom(fbox->fis, name, cmp_same_name);
-	if (search_result) {
-		fi = search_result->data;
+	fi = g_hash_table_lookup(fbox->fi_table, name);
+	if (fi) {
+		if (fi->type != type) {
+			/* It's going to be repositioned. */
+			file_box_remove_fitem(fbox, fi);
+			pos = file_box_insert_fitem(fbox, fi, rank);
+
+			if (!fbox->changed_fi)
+				fbox->changed_fi = fi;
+		}
 		points = fitem_update_type_selection_and_order(
-				fi, type, selection, fbox, rank);
+				fi, type, selection, fbox);
 	}
 	else {
 		fi = fitem_new(name, type, selection);
-		fbox->fis = g_slist_insert(fbox->fis, fi, rank);
+		g_hash_table_insert(fbox->fi_table, fi->name, fi);
+		pos = file_box_insert_fitem(fbox, fi, rank);
 		points = 2;
+
+		if (!fbox->changed_fi)
+			fbox->changed_fi = fi;
 	}
 
 	fi->marked = TRUE;
 
-	if (!fi->widget) {
+	/* Past the limit it's cheaper to draw them all ourselves. */
+	if (!fbox->virtual && fbox->file_display_limit &&
+			fbox->fis->len > fbox->file_display_limit)
+		file_box_set_virtual(fbox, TRUE);
+
+	if (!fi->widget && !fbox->virtual) {
 		/* Build widgets and pack it in. */
 		fitem_build_widgets(fi);
-		wrap_box_pack_pos(WRAP_BOX(fbox), fi->widget,
-				file_box_get_display_pos(fbox, fi), FALSE);
-
-		if (!fbox->changed_fi)
-			fbox->changed_fi = fi;
+		wrap_box_pack_pos(WRAP_BOX(fbox), fi->widget, pos, FALSE);
 	}
 
 	return points;
 }
 
 
-/* Get the position of this fitem in the box. */
-static guint file_box_get_display_pos(FileBox* fbox, FItem* fitem) {
-	GSList* fi_iter;
-	FItem* fi;
-	guint pos = 0;
+/* Put the fitem at the given rank (or at the end if the rank is past it),
+   shifting the ones after it down.  The display position is the same as the
+   position in fis, so return that. */
+static guint file_box_insert_fitem(FileBox* fbox, FItem* fi, gint rank) {
+	GPtrArray* fis = fbox->fis;
+	guint pos;
 
-	for (fi_iter = fbox->fis; fi_iter; fi_iter = g_slist_next(fi_iter)) {
-		fi = fi_iter->data;
-		if (fi == fitem)
-			break;
-		else
-			pos++;
-	}
+	if (rank < 0 || (guint) rank > fis->len)
+		pos = fis->len;
+	else
+		pos = rank;
+
+	g_ptr_array_add(fis, NULL);
+	memmove(fis->pdata + pos + 1, fis->pdata + pos,
+			(fis->len - 1 - pos) * sizeof(gpointer));
+	fis->pdata[pos] = fi;
 
 	return pos;
 }
 
 
+/* Take the fitem out of fis (but not the table). */
+static void file_box_remove_fitem(FileBox* fbox, FItem* fi) {
+	GPtrArray* fis = fbox->fis;
+	guint i;
+
+	for (i = 0; i < fis->len; i++) {
+		if (fis->pdata[i] == fi) {
+			g_ptr_array_remove_index(fis, i);
+			break;
+		}
+	}
+}
+
+
 /* Unmark all the FItems.  This is called just before reading in a new bunch
    of data. */
 void file_box_begin_read(FileBox* fbox) {
 	g_return_if_fail(IS_FILE_BOX(fbox));
 
-	GSList* fi_iter;
 	FItem* fi;
+	guint i;
 
-	for (fi_iter = fbox->fis; fi_iter; fi_iter = g_slist_next(fi_iter)) {
-		fi = fi_iter->data;
+	for (i = 0; i < fbox->fis->len; i++) {
+		fi = fbox->fis->pdata[i];
 		fi->marked = FALSE;
 	}
 
@@ -517,39 +605,396 @@ void file_box_begin_read(FileBox* fbox) {
 void file_box_flush(FileBox* fbox) {
 	g_return_if_fail(IS_FILE_BOX(fbox));
 
-	GSList* fi_iter;
-	GSList* tmp;
+	GPtrArray* fis = fbox->fis;
 	FItem* fi;
+	guint i, kept = 0;
 
-	fi_iter = fbox->fis;
-	while (fi_iter) {
-		fi = fi_iter->data;
-		if (!fi->marked ) {
+	/* Compact the survivors to the front as we go. */
+	for (i = 0; i < fis->len; i++) {
+		fi = fis->pdata[i];
+		if (!fi->marked) {
 			/* Not marked -- no holds barred. */
-			tmp = fi_iter;
-			fi_iter = g_slist_next(fi_iter);
-			fbox->fis = g_slist_delete_link(fbox->fis, tmp);
+			g_hash_table_remove(fbox->fi_table, fi->name);
 			fitem_free(fi, TRUE);
 			continue;
 		}
 		else if (fi->widget)
 			gtk_widget_show(fi->widget);
 
-		fi_iter = g_slist_next(fi_iter);
+		fis->pdata[kept++] = fi;
 	}
+	g_ptr_array_set_size(fis, kept);
+
+	/* Go back to widgets once there are few enough (with some slack so we
+	   don't flip back and forth). */
+	if (fbox->virtual && (!fbox->file_display_limit ||
+				fis->len <= fbox->file_display_limit / 2))
+		file_box_set_virtual(fbox, FALSE);
 
 	/* Now we do a size request. */
 	allow_size_requests(fbox, TRUE);
+
+	/* The FItems may have changed without the size changing. */
+	if (fbox->virtual)
+		gtk_widget_queue_draw(GTK_WIDGET(fbox));
+}
+
+
+/* The y position of the first FItem changed since file_box_begin_read(),
+   or -1 if there isn't one. */
+gint file_box_get_changed_y(FileBox* fbox) {
+	g_return_val_if_fail(IS_FILE_BOX(fbox), -1);
+
+	guint i;
+
+	if (!fbox->changed_fi)
+		return -1;
+	else if (!fbox->virtual)
+		return fbox->changed_fi->widget->allocation.y;
+	else if (!fbox->rows)
+		return -1;
+
+	for (i = 0; i < fbox->fis->len; i++) {
+		if (fbox->fis->pdata[i] == fbox->changed_fi) {
+			return GTK_WIDGET(fbox)->allocation.y +
+				GTK_CONTAINER(fbox)->border_width +
+				(i % fbox->rows) *
+				(fbox->row_height + WRAP_BOX(fbox)->vspacing);
+		}
+	}
+
+	return -1;
+}
+
+
+/* Switch between packing a widget for each FItem and drawing them
+   directly. */
+static void file_box_set_virtual(FileBox* fbox, gboolean setting) {
+	FItem* fi;
+	guint i;
+
+	if (fbox->virtual == setting)
+		return;
+	fbox->virtual = setting;
+
+	for (i = 0; i < fbox->fis->len; i++) {
+		fi = fbox->fis->pdata[i];
+		if (setting && fi->widget) {
+			gtk_widget_destroy(fi->widget);
+			fi->widget = NULL;
+		}
+		else if (!setting) {
+			fitem_build_widgets(fi);
+			wrap_box_pack_pos(WRAP_BOX(fbox), fi->widget, i, FALSE);
+			gtk_widget_show(fi->widget);
+		}
+	}
+
+	if (fbox->event_window && GTK_WIDGET_MAPPED(fbox)) {
+		if (setting)
+			gdk_window_show(fbox->event_window);
+		else
+			gdk_window_hide(fbox->event_window);
+	}
+
+	gtk_widget_queue_resize(GTK_WIDGET(fbox));
 }
 
 
 static void file_box_size_request(GtkWidget* widget,
 		GtkRequisition* requisition) {
 	FileBox* this = FILE_BOX(widget);
-	if (!this->eat_size_requests) {
+	if (!this->virtual) {
 		wrap_box_size_request_optimal(widget, requisition,
 				this->optimal_width);
 	}
+	else if (!WRAP_BOX(this)->freeze_count)
+		virtual_layout(this, this->optimal_width, requisition);
+}
+
+
+static void file_box_size_allocate(GtkWidget* widget,
+		GtkAllocation* allocation) {
+	FileBox* fbox = FILE_BOX(widget);
+
+	GTK_WIDGET_CLASS(parent_class)->size_allocate(widget, allocation);
+
+	if (fbox->event_window) {
+		gdk_window_move_resize(fbox->event_window,
+				allocation->x, allocation->y,
+				allocation->width, allocation->height);
+	}
+}
+
+
+/* FileBox has no window of its own, but a virtual FileBox needs to catch
+   clicks on the FItems it draws.  So it gets an input-only window over its
+   allocation, which is only shown while it's virtual. */
+static void file_box_realize(GtkWidget* widget) {
+	FileBox* fbox = FILE_BOX(widget);
+	GdkWindowAttr attributes;
+
+	GTK_WIDGET_CLASS(parent_class)->realize(widget);
+
+	attributes.window_type = GDK_WINDOW_CHILD;
+	attributes.x = widget->allocation.x;
+	attributes.y = widget->allocation.y;
+	attributes.width = widget->allocation.width;
+	attributes.height = widget->allocation.height;
+	attributes.wclass = GDK_INPUT_ONLY;
+	attributes.event_mask = gtk_widget_get_events(widget) |
+		GDK_BUTTON_PRESS_MASK;
+
+	fbox->event_window = gdk_window_new(widget->window, &attributes,
+			GDK_WA_X | GDK_WA_Y);
+	gdk_window_set_user_data(fbox->event_window, widget);
+}
+
+
+static void file_box_unrealize(GtkWidget* widget) {
+	FileBox* fbox = FILE_BOX(widget);
+
+	if (fbox->event_window) {
+		gdk_window_set_user_data(fbox->event_window, NULL);
+		gdk_window_destroy(fbox->event_window);
+		fbox->event_window = NULL;
+	}
+
+	GTK_WIDGET_CLASS(parent_class)->unrealize(widget);
+}
+
+
+static void file_box_map(GtkWidget* widget) {
+	FileBox* fbox = FILE_BOX(widget);
+
+	GTK_WIDGET_CLASS(parent_class)->map(widget);
+
+	if (fbox->virtual && fbox->event_window)
+		gdk_window_show(fbox->event_window);
+}
+
+
+static void file_box_unmap(GtkWidget* widget) {
+	FileBox* fbox = FILE_BOX(widget);
+
+	if (fbox->event_window)
+		gdk_window_hide(fbox->event_window);
+
+	GTK_WIDGET_CLASS(parent_class)->unmap(widget);
+}
+
+
+static gint file_box_expose_event(GtkWidget* widget,
+		GdkEventExpose* event) {
+	FileBox* fbox = FILE_BOX(widget);
+
+	if (fbox->virtual && GTK_WIDGET_DRAWABLE(widget))
+		virtual_draw(fbox, &event->area);
+
+	return GTK_WIDGET_CLASS(parent_class)->expose_event(widget, event);
+}
+
+
+static gint file_box_button_press_event(GtkWidget* widget,
+		GdkEventButton* event) {
+	FileBox* fbox = FILE_BOX(widget);
+	FItem* fi;
+
+	/* Same as fitem_button_press_event(), except we have to figure out
+	   which FItem was clicked. */
+	if (fbox->virtual && event->window == fbox->event_window &&
+			event->type == GDK_2BUTTON_PRESS && event->button == 1) {
+		fi = virtual_hit(fbox, event->x, event->y);
+		if (fi)
+			fitem_write_name(fi);
+	}
+
+	return FALSE;
+}
+
+
+/* Lay the FItems out the way WrapBox would lay out their widgets: top to
+   bottom in as many columns as will fit in the given width.  Every FItem is
+   the same height, so a column is just a slice of fis, and all that needs
+   remembering is where each column starts. */
+static void virtual_layout(FileBox* fbox, guint width,
+		GtkRequisition* requisition) {
+	GPtrArray* fis = fbox->fis;
+	FItem* fi;
+	guint border = GTK_CONTAINER(fbox)->border_width;
+	guint hspacing = WRAP_BOX(fbox)->hspacing;
+	guint vspacing = WRAP_BOX(fbox)->vspacing;
+	guint i, cols, rows, x, row_width;
+	guint col_width = 0;
+	gint start;
+
+	width = width > border * 2 ? width - border * 2 : 0;
+
+	if (fbox->measure_serial != sizing_serial) {
+		for (i = 0; i < fis->len; i++) {
+			fi = fis->pdata[i];
+			fi->width = 0;
+		}
+		fbox->measure_serial = sizing_serial;
+	}
+
+	/* Measure anything new, and get an upper bound on the number of
+	   columns. */
+	fbox->row_height = 0;
+	row_width = 0;
+	cols = 0;
+	for (i = 0; i < fis->len; i++) {
+		fi = fis->pdata[i];
+		if (!fi->width)
+			fitem_measure(fi, fbox);
+		fbox->row_height = MAX(fbox->row_height, (guint) fi->height);
+
+		if (cols == i) {
+			row_width += (cols ? hspacing : 0) + fi->width;
+			if (row_width <= width)
+				cols++;
+		}
+	}
+
+	/* Use the most columns that fit (at least one). */
+	rows = 0;
+	for (cols = MAX(cols, 1); fis->len; cols--) {
+		rows = (fis->len + cols - 1) / cols;
+		if (cols == 1 || virtual_columns_width(fbox, rows, width) <= width)
+			break;
+	}
+	fbox->rows = rows;
+
+	/* Remember where each column starts. */
+	g_array_set_size(fbox->col_x, 0);
+	x = border;
+	for (i = 0; i < fis->len; i++) {
+		fi = fis->pdata[i];
+		if (i % rows == 0) {
+			if (i) {
+				x += col_width + hspacing;
+				col_width = 0;
+			}
+			start = x;
+			g_array_append_val(fbox->col_x, start);
+		}
+		col_width = MAX(col_width, (guint) fi->width);
+	}
+	x += col_width;
+
+	if (rows) {
+		requisition->width = x + border;
+		requisition->height = rows * fbox->row_height +
+			(rows - 1) * vspacing + border * 2;
+	}
+	else {
+		requisition->width = border * 2;
+		requisition->height = border * 2;
+	}
+}
+
+
+/* Total width of the FItems when laid out in columns of the given number of
+   rows.  Gives up early once it's past the limit. */
+static guint virtual_columns_width(FileBox* fbox, guint rows, guint limit) {
+	GPtrArray* fis = fbox->fis;
+	FItem* fi;
+	guint i;
+	guint total = 0, col_width = 0;
+
+	for (i = 0; i < fis->len; i++) {
+		fi = fis->pdata[i];
+		if (i && i % rows == 0) {
+			total += col_width + WRAP_BOX(fbox)->hspacing;
+			col_width = 0;
+			if (total > limit)
+				return total;
+		}
+		col_width = MAX(col_width, (guint) fi->width);
+	}
+
+	return total + col_width;
+}
+
+
+/* Draw the FItems which fall within the area, which (since we're in a
+   viewport) is at most what's visible of the scrolled window. */
+static void virtual_draw(FileBox* fbox, GdkRectangle* area) {
+	GtkWidget* widget = GTK_WIDGET(fbox);
+	GArray* col_x = fbox->col_x;
+	guint pitch = fbox->row_height + WRAP_BOX(fbox)->vspacing;
+	gint x0 = widget->allocation.x;
+	gint y0 = widget->allocation.y + GTK_CONTAINER(fbox)->border_width;
+	gint top, bottom;
+	gint x, next_x;
+	guint col, row, first_row, last_row, i;
+
+	if (!fbox->rows || !pitch)
+		return;
+
+	top = area->y - y0;
+	bottom = area->y + area->height - y0;
+	if (bottom <= 0)
+		return;
+	first_row = top > 0 ? top / pitch : 0;
+	last_row = MIN((bottom - 1) / pitch, fbox->rows - 1);
+
+	for (col = 0; col < col_x->len; col++) {
+		x = x0 + g_array_index(col_x, gint, col);
+		if (col + 1 < col_x->len)
+			next_x = x0 + g_array_index(col_x, gint, col + 1);
+		else
+			next_x = x0 + widget->allocation.width;
+
+		if (next_x <= area->x)
+			continue;
+		else if (x >= area->x + area->width)
+			break;
+
+		for (row = first_row; row <= last_row; row++) {
+			i = col * fbox->rows + row;
+			if (i >= fbox->fis->len)
+				break;
+			fitem_draw(fbox->fis->pdata[i], fbox, x, y0 + row * pitch);
+		}
+	}
+}
+
+
+/* Find the FItem at (x, y), relative to the FileBox's allocation. */
+static FItem* virtual_hit(FileBox* fbox, gint x, gint y) {
+	GArray* col_x = fbox->col_x;
+	guint pitch = fbox->row_height + WRAP_BOX(fbox)->vspacing;
+	FItem* fi;
+	guint col, row, i;
+
+	y -= GTK_CONTAINER(fbox)->border_width;
+	if (!fbox->rows || !pitch || y < 0)
+		return NULL;
+
+	row = y / pitch;
+	if (row >= fbox->rows)
+		return NULL;
+
+	for (col = col_x->len; col > 0; col--) {
+		if (g_array_index(col_x, gint, col - 1) <= x)
+			break;
+	}
+	if (col == 0)
+		return NULL;
+	col--;
+
+	i = col * fbox->rows + row;
+	if (i >= fbox->fis->len)
+		return NULL;
+
+	/* Make sure it's not in the spacing. */
+	fi = fbox->fis->pdata[i];
+	if (x - g_array_index(col_x, gint, col) >= fi->width ||
+			(gint) (y - row * pitch) >= fi->height)
+		return NULL;
+
+	return fi;
 }
 
 
@@ -562,6 +1007,8 @@ static FItem* fitem_new(const gchar* name, FileType type,
 	new_fitem->type = type;
 	new_fitem->selection = selection;
 	new_fitem->widget = NULL;
+	new_fitem->width = 0;
+	new_fitem->height = 0;
 
 	return new_fitem;
 }
@@ -640,24 +1087,111 @@ static gboolean fitem_button_press_event(GtkWidget* widget,
 	g_return_val_if_fail(fi != NULL, FALSE);
 
 	/* Write out the FItem's name upon a double click. */
-	if (event->type == GDK_2BUTTON_PRESS && event->button == 1) {
+	if (event->type == GDK_2BUTTON_PRESS && event->button == 1)
+		fitem_write_name(fi);
+
+	return FALSE;
+}
+
+
+static void fitem_write_name(FItem* fi) {
+
+	GString* string = g_string_new(NULL);
+
+	string = g_string_append(string, fi->name);
+
+	/* Trailing '/' on directories. */
+	if (fi->type == FT_DIRECTORY)
+		string = g_string_append(string, "/");
+
+	/* Write out the file name. */
+	if (!put_param(STDOUT_FILENO, P_FILE, string->str))
+		g_warning("Could not write filename to stdout");
+
+	g_string_free(string, TRUE);
+}
+
+
+/* Put the FItem's name (in utf8) and LS_COLORS attributes in the layout.
+   Returns the foreground colour, if it's not the default. */
+static GdkColor* fitem_set_layout(FItem* fi, PangoLayout* layout) {
 
-			GString* string = g_string_new(NULL);
+	gchar* text;
+	gsize  length;
+
+	text = g_filename_to_utf8(fi->name, strlen(fi->name), NULL, &length,
+			NULL);
+	pango_layout_set_text(layout, text ? text : "", -1);
+	g_free(text);
 
-			string = g_string_append(string, fi->name);
+	return layout_set_attributes(fi->name, fi->type, layout);
+}
 
-			/* Trailing '/' on directories. */
-			if (fi->type == FT_DIRECTORY)
-				string = g_string_append(string, "/");
 
-			/* Write out the file name. */
-			if (!put_param(STDOUT_FILENO, P_FILE, string->str))
-				g_warning("Could not write filename to stdout");
+/* Figure out how much space the FItem takes up when drawn, which is the
+   same as its widgets would request. */
+static void fitem_measure(FItem* fi, FileBox* fbox) {
 
-			g_string_free(string, TRUE);
+	GdkPixbuf* icon = file_type_icons[fi->type];
+	gint width, height;
+
+	if (!fbox->layout) {
+		fbox->layout = gtk_widget_create_pango_layout(GTK_WIDGET(fbox),
+				NULL);
 	}
 
-	return FALSE;
+	(void) fitem_set_layout(fi, fbox->layout);
+	pango_layout_get_pixel_size(fbox->layout, &width, &height);
+	width += LABEL_XPAD * 2;
+
+	if (icon) {
+		width += gdk_pixbuf_get_width(icon) + ICON_XPAD * 2;
+		height = MAX(height, gdk_pixbuf_get_height(icon));
+	}
+
+	fi->width = width;
+	fi->height = height;
+}
+
+
+/* Draw the FItem at (x, y) in the FileBox's window, the way its widgets
+   would look. */
+static void fitem_draw(FItem* fi, FileBox* fbox, gint x, gint y) {
+
+	GtkWidget* widget = GTK_WIDGET(fbox);
+	GtkStateType state = selection_to_state(fi->selection);
+	GdkPixbuf* icon = file_type_icons[fi->type];
+	GdkColor* fg;
+	gint height;
+
+	/* Selection shows as the event box's background. */
+	if (state != GTK_STATE_NORMAL) {
+		gdk_draw_rectangle(widget->window, widget->style->bg_gc[state], TRUE,
+				x, y, fi->width, fi->height);
+	}
+
+	if (icon) {
+		gdk_draw_pixbuf(widget->window, NULL, icon, 0, 0, x + ICON_XPAD,
+				y + (fi->height - gdk_pixbuf_get_height(icon)) / 2, -1, -1,
+				GDK_RGB_DITHER_NORMAL, 0, 0);
+		x += gdk_pixbuf_get_width(icon) + ICON_XPAD * 2;
+	}
+
+	fg = fitem_set_layout(fi, fbox->layout);
+	pango_layout_get_pixel_size(fbox->layout, NULL, &height);
+	y += (fi->height - height) / 2;
+
+	/* The LS_COLORS foreground only applies in the normal state, as with
+	   the labels. */
+	if (fg && state == GTK_STATE_NORMAL) {
+		gdk_draw_layout_with_colors(widget->window,
+				widget->style->fg_gc[state], x + LABEL_XPAD, y,
+				fbox->layout, fg, NULL);
+	}
+	else {
+		gdk_draw_layout(widget->window, widget->style->fg_gc[state],
+				x + LABEL_XPAD, y, fbox->layout);
+	}
 }
 
 
@@ -676,7 +1210,7 @@ static void fitem_free(FItem* fi, gboolean destroy_widgets) {
 
 
 static int fitem_update_type_selection_and_order(FItem* fi, FileType t,
-		FileSelection s, FileBox* fbox, gint rank) {
+		FileSelection s, FileBox* fbox) {
 
 	gint points = 0;
 
@@ -691,9 +1225,8 @@ static int fitem_update_type_selection_and_order(FItem* fi, FileType t,
 			fi->widget = NULL;
 		}
 
-		/* Reposition this FItem. */
-		fbox->fis = g_slist_remove(fbox->fis, fi);
-		fbox->fis = g_slist_insert(fbox->fis, fi, rank);
+		/* It'll look different when drawn, too. */
+		fi->width = 0;
 
 		points = 2;
 	}
@@ -716,10 +1249,3 @@ static int fitem_update_type_selection_and_order(FItem* fi, FileType t,
 }
 
 
-static gint cmp_same_name(gconstpointer a, gconstpointer b) {
-	const FItem* aa = a;
-	const gchar* bb = b;
-
-	return strcmp(aa->name, bb);
-}
-
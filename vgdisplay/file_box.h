@@ -47,9 +47,23 @@ struct _FileBox {
 	gboolean  show_hidden_files;
 	guint     file_display_limit;
 
-	gboolean  eat_size_requests;
+	gboolean  frozen;
 	FItem*    changed_fi;
-	GSList*   fis;
+
+	/* FItems in display order, and the same FItems by name. */
+	GPtrArray*  fis;
+	GHashTable* fi_table;
+
+	/* Past file_display_limit FItems, the FileBox stops making widgets for
+	   them and draws them itself.  These describe where they went the last
+	   time they were laid out. */
+	gboolean      virtual;
+	GdkWindow*    event_window;
+	PangoLayout*  layout;
+	guint         measure_serial;
+	guint         rows;
+	guint         row_height;
+	GArray*       col_x;
 };
 
 struct _FileBoxClass {
@@ -64,6 +78,10 @@ struct _FItem {
 
 	/* An FItem is "marked" if it's been seen after a begin_read. */
 	gboolean             marked;
+
+	/* Size when drawn by a virtual FileBox (0 if not yet measured). */
+	gint                 width;
+	gint                 height;
 };
 
 
@@ -77,6 +95,7 @@ int         file_box_add(FileBox* fbox, gchar* name, FileType type,
 		FileSelection selection, gint rank);
 void        file_box_begin_read(FileBox* fbox);
 void        file_box_flush(FileBox* fbox);
+gint        file_box_get_changed_y(FileBox* fbox);
 
 void        file_box_set_icon(FileType type, GdkPixbuf* icon);
 void        file_box_set_sizing(gint modifier, gboolean use_icons);
@@ -767,27 +767,35 @@ static PangoAttrList* create_pango_list(TermTextAttr* tta, gint size_modifier) {
 
 
 /* Get a PangoAttrList for this label, based on its name and type.  */
-void label_set_attributes(gchar* name, FileType type, GtkLabel* label) {
+/* Get the attributes for a file of this name and type. */
+static TermTextAttr* lookup_tta(const gchar* name, FileType type) {
 
-	PangoAttrList* p_list;
 	TermTextAttr* tta;
 
 	tta = &type_ttas[type];
 
-	p_list = tta->p_list;
 	if (type == FT_REGULAR) {
 		struct color_ext_type* iter;
 		for (iter = color_ext_list; iter; iter = iter->next) {
 			if (g_str_has_suffix(name, iter->ext.gstr->str)) {
 				tta = &iter->tta;
-				p_list = tta->p_list;
 				break;
 			}
 		}
 	}
 
-	if (p_list)
-		gtk_label_set_attributes(label, p_list);
+	return tta;
+}
+
+
+void label_set_attributes(gchar* name, FileType type, GtkLabel* label) {
+
+	TermTextAttr* tta;
+
+	tta = lookup_tta(name, type);
+
+	if (tta->p_list)
+		gtk_label_set_attributes(label, tta->p_list);
 
 	/* Foreground colour */
 	if (tta->fg > TCC_NONE && tta->fg <= TCC_WHITE) {
@@ -798,6 +806,25 @@ void label_set_attributes(gchar* name, FileType type, GtkLabel* label) {
 }
 
 
+/* The same as label_set_attributes(), but for a bare PangoLayout.  There's
+   no widget to hold the foreground colour, so it's returned instead (NULL if
+   the default should be used). */
+GdkColor* layout_set_attributes(const gchar* name, FileType type,
+		PangoLayout* layout) {
+
+	TermTextAttr* tta;
+
+	tta = lookup_tta(name, type);
+
+	pango_layout_set_attributes(layout, tta->p_list);
+
+	if (tta->fg > TCC_NONE && tta->fg <= TCC_WHITE)
+		return &map[tta->fg];
+	else
+		return NULL;
+}
+
+
 void set_color(enum term_color_code code, GdkColor* color) {
 	map[code].red = color->red;
 	map[code].green = color->green;
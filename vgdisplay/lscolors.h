@@ -54,6 +54,8 @@ struct _TermTextAttr {
 
 void parse_ls_colors(gint size_modifier);
 void label_set_attributes(gchar* name, FileType type, GtkLabel* label);
+GdkColor* layout_set_attributes(const gchar* name, FileType type,
+		PangoLayout* layout);
 void set_color(enum term_color_code code, GdkColor* color);
 
 #endif /* !LSCOLORS_H */
@@ -25,6 +25,7 @@
 #include "dlisting.h"
 #include "exhibit.h"
 #include "param-io.h"
+#include "hardened-io.h"
 #include "syslogging.h"
 
 #include <gtk/gtk.h>
@@ -42,17 +43,22 @@ static void window_allocate_event(GtkWidget* window,
 		GtkAllocation* allocation, Exhibit* e);
 
 
+/* Results which arrived with more already queued behind them. */
+static GString* pending = NULL;
+
+
 /* Receive data from vgd. */
 static gboolean receive_data(GIOChannel* source, GIOCondition condition,
 		gpointer data) {
 
 	enum parameter param;
 	gchar* value;
+	gsize len;
 
 	Exhibit* e = data;
 	int fd = g_io_channel_unix_get_fd(source);
 	
-	if (get_param(fd, &param, &value)) {
+	if (get_param_len(fd, &param, &value, &len)) {
 		switch (param) {
 
 			case P_ORDER:
@@ -86,8 +92,20 @@ static gboolean receive_data(GIOChannel* source, GIOCondition condition,
 				break;
 
 			case P_VGEXPAND_DATA:
-				if (*value != '\0')
-					process_glob_data(value, strlen(value), e);
+				/* Drawing results that are about to be replaced is wasted
+				   work, so hold on to them until the queue runs dry. */
+				if (len > 0 && data_waiting(fd)) {
+					if (!pending)
+						pending = g_string_sized_new(len);
+					pending = g_string_truncate(pending, 0);
+					pending = g_string_append_len(pending, value, len);
+				}
+				else {
+					if (pending)
+						pending = g_string_truncate(pending, 0);
+					if (len > 0)
+						process_glob_data(value, len, e);
+				}
 				break;
 
 			case P_EOF:
@@ -106,107 +124,36 @@ static gboolean receive_data(GIOChannel* source, GIOCondition condition,
 		exit(EXIT_FAILURE);
 	}
 
+	if (pending && pending->len > 0 && !data_waiting(fd)) {
+		process_glob_data(pending->str, pending->len, e);
+		pending = g_string_truncate(pending, 0);
+	}
+
 	return TRUE;
 }
 
 
-/* Finite state machine to interpret glob data. */
+/* Interpret glob data. */
 static void process_glob_data(gchar* buf, gsize bytes, Exhibit* e) {
 
-	enum glob_read_state rs;
-
-	gchar* string = NULL;
-	gchar* selected_count = NULL;
-	gchar* total_count = NULL;
-	gchar* hidden_count = NULL;
-
-	static FileType type = FT_REGULAR;
-	static FileSelection selection = FS_NO;
+	struct glob_reader reader;
+	struct glob_record rec;
 
 	gint dir_rank = -1;
 	gint file_rank = -1;
 	DListing* dl = NULL;
 
-	gchar* p;
-
-	p = buf;
-	rs = GRS_DONE;
-	while (p < buf + bytes) {
-
-		switch (rs) {
-			case GRS_DONE:
-				dir_rank = -1;
-				exhibit_unmark_all(e);
-				rs = GRS_SELECTED_COUNT;
-				break;
-
-			case GRS_SELECTED_COUNT:
-				selected_count = up_to_delimiter(&p, ' ');
-				dir_rank++;
-				rs = GRS_FILE_COUNT;
-				break;
-
-			case GRS_FILE_COUNT:
-				total_count = up_to_delimiter(&p, ' ');
-				rs = GRS_HIDDEN_COUNT;
-				break;
-
-			case GRS_HIDDEN_COUNT:
-				hidden_count = up_to_delimiter(&p, ' ');
-				rs = GRS_DIR_NAME;
-				break;
-
-			/* Get dl, the DListing we're currently working on, from here. */
-			case GRS_DIR_NAME:
-				string = up_to_delimiter(&p, '\n');
-				dl = exhibit_add(e, string, dir_rank, selected_count,
-						total_count, hidden_count);
-				file_rank = -1;
-				rs = GRS_IN_LIMBO;
-				break;
-
-			/* Either we'll read another FItem (or the first), a new DListing,
-			   or EOF (double \n). */
-			case GRS_IN_LIMBO:
-				switch (*p) {
-					case '\t':
-						rs = GRS_FILE_STATE;
-						p++;
-						break;
-					case '\n':
-						rs = GRS_DONE;
-						p++;
-						break;
-					default:
-						rs = GRS_SELECTED_COUNT;
-						break;
-				}
-				break;
-
-			/* Have to save selection and type until we get the name */
-			case GRS_FILE_STATE:
-				string = up_to_delimiter(&p, ' ');
-				selection = map_selection_state(*string);
-				file_rank++;
-				rs = GRS_FILE_TYPE;
-				break;
-
-			case GRS_FILE_TYPE:
-				string = up_to_delimiter(&p, ' ');
-				type = map_file_type(*string);
-				rs = GRS_FILE_NAME;
-				break;
-
-			case GRS_FILE_NAME:
-				string = up_to_delimiter(&p, '\n');
-				file_box_add(FILE_BOX(dl->file_box), string, type, selection,
-						file_rank);
-				rs = GRS_IN_LIMBO;
-				break;
-
-			default:
-				g_error("Unexpected read state in process_glob_data.");
-				break;
+	exhibit_unmark_all(e);
+	glob_reader_init(&reader, buf, bytes);
+	while (glob_reader_next(&reader, &rec)) {
+		if (rec.type == ER_DIR) {
+			dl = exhibit_add(e, rec.name, ++dir_rank, rec.selected,
+					rec.total, rec.hidden);
+			file_rank = -1;
+		}
+		else if (dl) {
+			file_box_add(FILE_BOX(dl->file_box), rec.name, rec.file_type,
+					rec.selection, ++file_rank);
 		}
 	}
 
@@ -334,6 +281,11 @@ gint main(gint argc, gchar **argv) {
 	}
 	g_io_channel_set_encoding(stdin_ioc, NULL, NULL);
 	g_io_channel_set_flags(stdin_ioc, G_IO_FLAG_NONBLOCK, NULL);
+
+	/* vgd talks to its displays in binary framing. */
+	param_io_set_framing(STDIN_FILENO, PF_BINARY);
+	param_io_set_framing(STDOUT_FILENO, PF_BINARY);
+
 	g_io_add_watch(stdin_ioc, G_IO_IN, receive_data, &e);
 
 	/*gdk_window_set_debug_updates(TRUE);*/
@@ -23,6 +23,7 @@
 #include "dircont.h"
 #include "file_box.h"
 #include "param-io.h"
+#include "hardened-io.h"
 #include "syslogging.h"
 
 #include <string.h>
@@ -147,6 +148,11 @@ gint main(gint argc, char** argv) {
 	}
 	g_io_channel_set_encoding(stdin_ioc, NULL, NULL);
 	g_io_channel_set_flags(stdin_ioc, G_IO_FLAG_NONBLOCK, NULL);
+
+	/* vgd talks to its displays in binary framing. */
+	param_io_set_framing(STDIN_FILENO, PF_BINARY);
+	param_io_set_framing(STDOUT_FILENO, PF_BINARY);
+
 	g_io_add_watch(stdin_ioc, G_IO_IN, receive_data, &vg);
 
 	gtk_widget_show(vg.window);
@@ -160,17 +166,22 @@ gint main(gint argc, char** argv) {
 }
 
 
+/* Results which arrived with more already queued behind them. */
+static GString* pending = NULL;
+
+
 /* Receive data from vgd. */
 static gboolean receive_data(GIOChannel* source, GIOCondition condition,
 		gpointer data) {
 
 	enum parameter param;
 	gchar* value;
+	gsize len;
 
 	struct vgmini* vg = data;
 	int fd = g_io_channel_unix_get_fd(source);
 	
-	if (get_param(fd, &param, &value)) {
+	if (get_param_len(fd, &param, &value, &len)) {
 		switch (param) {
 
 			case P_ORDER:
@@ -226,8 +237,20 @@ static gboolean receive_data(GIOChannel* source, GIOCondition condition,
 				break;
 
 			case P_VGEXPAND_DATA:
-				if (*value != '\0')
-					process_glob_data(value, strlen(value), vg);
+				/* Drawing results that are about to be replaced is wasted
+				   work, so hold on to them until the queue runs dry. */
+				if (len > 0 && data_waiting(fd)) {
+					if (!pending)
+						pending = g_string_sized_new(len);
+					pending = g_string_truncate(pending, 0);
+					pending = g_string_append_len(pending, value, len);
+				}
+				else {
+					if (pending)
+						pending = g_string_truncate(pending, 0);
+					if (len > 0)
+						process_glob_data(value, len, vg);
+				}
 				break;
 
 			case P_EOF:
@@ -246,107 +269,36 @@ static gboolean receive_data(GIOChannel* source, GIOCondition condition,
 		exit(EXIT_FAILURE);
 	}
 
+	if (pending && pending->len > 0 && !data_waiting(fd)) {
+		process_glob_data(pending->str, pending->len, vg);
+		pending = g_string_truncate(pending, 0);
+	}
+
 	return TRUE;
 }
 
 
-/* Finite state machine to interpret glob data. */
+/* Interpret glob data. */
 static void process_glob_data(gchar* buf, gsize bytes, struct vgmini* vg) {
 
-	enum glob_read_state rs;
-
-	gchar* string = NULL;
-	gchar* selected = NULL;
-	gchar* total = NULL;
-	gchar* hidden = NULL;
-
-	static FileType type = FT_REGULAR;
-	static FileSelection selection = FS_NO;
+	struct glob_reader reader;
+	struct glob_record rec;
 
 	gint dir_rank = -1;
 	gint file_rank = -1;
 	DirCont* dc = NULL;
 
-	gchar* p;
-
-	p = buf;
-	rs = GRS_DONE;
-	while (p < buf + bytes) {
-
-		switch (rs) {
-			case GRS_DONE:
-				dir_rank = -1;
-				unmark_all_dirconts(vg);
-				rs = GRS_SELECTED_COUNT;
-				break;
-
-			case GRS_SELECTED_COUNT:
-				selected = up_to_delimiter(&p, ' ');
-				dir_rank++;
-				rs = GRS_FILE_COUNT;
-				break;
-
-			case GRS_FILE_COUNT:
-				total = up_to_delimiter(&p, ' ');
-				rs = GRS_HIDDEN_COUNT;
-				break;
-
-			case GRS_HIDDEN_COUNT:
-				hidden = up_to_delimiter(&p, ' ');
-				rs = GRS_DIR_NAME;
-				break;
-
-			/* Get dc, the DirCont we're currently working on, from here. */
-			case GRS_DIR_NAME:
-				string = up_to_delimiter(&p, '\n');
-				dc = add_dircont(vg, string, dir_rank, selected,
-						total, hidden);
-				file_rank = -1;
-				rs = GRS_IN_LIMBO;
-				break;
-
-			/* Either we'll read another FItem (or the first), a new DListing,
-			   or EOF (double \n). */
-			case GRS_IN_LIMBO:
-				switch (*p) {
-					case '\t':
-						rs = GRS_FILE_STATE;
-						p++;
-						break;
-					case '\n':
-						rs = GRS_DONE;
-						p++;
-						break;
-					default:
-						rs = GRS_SELECTED_COUNT;
-						break;
-				}
-				break;
-
-			/* Have to save selection and type until we get the name */
-			case GRS_FILE_STATE:
-				string = up_to_delimiter(&p, ' ');
-				selection = map_selection_state(*string);
-				file_rank++;
-				rs = GRS_FILE_TYPE;
-				break;
-
-			case GRS_FILE_TYPE:
-				string = up_to_delimiter(&p, ' ');
-				type = map_file_type(*string);
-				rs = GRS_FILE_NAME;
-				break;
-
-			case GRS_FILE_NAME:
-				string = up_to_delimiter(&p, '\n');
-				dc->score += file_box_add(FILE_BOX(dc->file_box),
-						string, type, selection, file_rank);
-				rs = GRS_IN_LIMBO;
-				break;
-
-			default:
-				g_error("Unexpected read state in process_glob_data.");
-				break;
+	unmark_all_dirconts(vg);
+	glob_reader_init(&reader, buf, bytes);
+	while (glob_reader_next(&reader, &rec)) {
+		if (rec.type == ER_DIR) {
+			dc = add_dircont(vg, rec.name, ++dir_rank, rec.selected,
+					rec.total, rec.hidden);
+			file_rank = -1;
+		}
+		else if (dc) {
+			dc->score += file_box_add(FILE_BOX(dc->file_box), rec.name,
+					rec.file_type, rec.selection, ++file_rank);
 		}
 	}
 
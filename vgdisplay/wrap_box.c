@@ -70,6 +70,7 @@ static GSList*  reverse_list_col_children(WrapBox *wbox, WrapBoxChild **child_p,
 
 static guint get_n_visible_children(WrapBox* this);
 static guint get_upper_bound_cols(WrapBox* this, guint optimal_width);
+static gboolean update_child_requisitions(WrapBox* this);
 
 
 /* --- variables --- */
@@ -207,6 +208,9 @@ static void wrap_box_init(WrapBox *wbox) {
 	wbox->n_children = 0;
 	wbox->children = NULL;
 	wbox->child_limit = 32767;
+	wbox->freeze_count = 0;
+	wbox->cache_valid = FALSE;
+	wbox->cached_width = 0;
 }
 
 
@@ -232,8 +236,10 @@ static void wrap_box_set_property (GObject *object, guint property_id, const GVa
 			wrap_box_set_vspacing (wbox, g_value_get_uint (value));
 			break;
 		case PROP_CHILD_LIMIT:
-			if (wbox->child_limit != g_value_get_uint (value))
+			if (wbox->child_limit != g_value_get_uint (value)) {
+				wbox->cache_valid = FALSE;
 				gtk_widget_queue_resize (GTK_WIDGET (wbox));
+			}
 			break;
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
@@ -317,6 +323,7 @@ void wrap_box_set_hspacing(WrapBox *wbox, guint hspacing) {
 
 	if (wbox->hspacing != hspacing) {
 		wbox->hspacing = hspacing;
+		wbox->cache_valid = FALSE;
 		gtk_widget_queue_resize (GTK_WIDGET (wbox));
 	}
 }
@@ -326,6 +333,7 @@ void wrap_box_set_vspacing(WrapBox *wbox, guint vspacing) {
 	
 	if (wbox->vspacing != vspacing) {
 		wbox->vspacing = vspacing;
+		wbox->cache_valid = FALSE;
 		gtk_widget_queue_resize (GTK_WIDGET (wbox));
 	}
 }
@@ -336,6 +344,7 @@ void wrap_box_set_justify(WrapBox *wbox, GtkJustification justify) {
 
 	if (wbox->justify != justify) {
 		wbox->justify = justify;
+		wbox->cache_valid = FALSE;
 		gtk_widget_queue_resize (GTK_WIDGET (wbox));
 	}
 }
@@ -346,6 +355,7 @@ void wrap_box_set_line_justify(WrapBox *wbox, GtkJustification line_justify) {
 
 	if (wbox->line_justify != line_justify) {
 		wbox->line_justify = line_justify;
+		wbox->cache_valid = FALSE;
 		gtk_widget_queue_resize (GTK_WIDGET (wbox));
 	}
 }
@@ -380,6 +390,9 @@ void wrap_box_pack(WrapBox *wbox, GtkWidget *child, gboolean do_resize) {
 
 	child_info = g_new (WrapBoxChild, 1);
 	child_info->widget = child;
+	child_info->visible = FALSE;
+	child_info->requisition.width = 0;
+	child_info->requisition.height = 0;
 	child_info->next = NULL;
 	if (wbox->children) {
 		WrapBoxChild *last = wbox->children;
@@ -391,6 +404,7 @@ void wrap_box_pack(WrapBox *wbox, GtkWidget *child, gboolean do_resize) {
 	else
 		wbox->children = child_info;
 	wbox->n_children++;
+	wbox->cache_valid = FALSE;
 
 	gtk_widget_set_parent (child, GTK_WIDGET (wbox));
 
@@ -401,7 +415,7 @@ void wrap_box_pack(WrapBox *wbox, GtkWidget *child, gboolean do_resize) {
 		if (GTK_WIDGET_MAPPED (wbox))
 			gtk_widget_map (child);
 
-		if (do_resize)
+		if (do_resize && !wbox->freeze_count)
 			gtk_widget_queue_resize (child);
 	}
 }
@@ -417,6 +431,9 @@ void wrap_box_pack_pos(WrapBox* wbox, GtkWidget* child, guint pos, gboolean do_r
 
 	child_info = g_new(WrapBoxChild, 1);
 	child_info->widget = child;
+	child_info->visible = FALSE;
+	child_info->requisition.width = 0;
+	child_info->requisition.height = 0;
 	
 	if (wbox->children) {
 		WrapBoxChild* iter = wbox->children;
@@ -437,6 +454,7 @@ void wrap_box_pack_pos(WrapBox* wbox, GtkWidget* child, guint pos, gboolean do_r
 		child_info->next = NULL;
 	}
 	wbox->n_children++;
+	wbox->cache_valid = FALSE;
 
 	gtk_widget_set_parent(child, GTK_WIDGET(wbox));
 
@@ -447,7 +465,7 @@ void wrap_box_pack_pos(WrapBox* wbox, GtkWidget* child, guint pos, gboolean do_r
 		if (GTK_WIDGET_MAPPED(wbox))
 			gtk_widget_map(child);
 
-		if (do_resize)
+		if (do_resize && !wbox->freeze_count)
 			gtk_widget_queue_resize (child);
 	}
 }
@@ -490,8 +508,10 @@ void wrap_box_reorder_child (WrapBox *wbox, GtkWidget *child, gint position) {
 			else
 				wbox->children = child_info;
 		}
+		wbox->cache_valid = FALSE;
 
-		if (GTK_WIDGET_VISIBLE (child) && GTK_WIDGET_VISIBLE (wbox))
+		if (GTK_WIDGET_VISIBLE (child) && GTK_WIDGET_VISIBLE (wbox) &&
+				!wbox->freeze_count)
 			gtk_widget_queue_resize (child);
 	}
 }
@@ -549,8 +569,9 @@ void wrap_box_remove (GtkContainer *container, GtkWidget *widget, gboolean do_re
 				wbox->children = child->next;
 			g_free (child);
 			wbox->n_children--;
+			wbox->cache_valid = FALSE;
 
-			if (was_visible && do_resize)
+			if (was_visible && do_resize && !wbox->freeze_count)
 				gtk_widget_queue_resize (GTK_WIDGET (container));
 
 			break;
@@ -578,27 +599,53 @@ static void wrap_box_forall (GtkContainer *container, gboolean include_internals
 
 /* --- */
 
-static inline void get_child_requisition (WrapBox *wbox, GtkWidget *child, GtkRequisition *child_requisition) {
-		gtk_widget_get_child_requisition (child, child_requisition);
+static inline void get_child_requisition (WrapBox *wbox, WrapBoxChild *child, GtkRequisition *child_requisition) {
+		*child_requisition = child->requisition;
+}
+
+
+/* Bring the cached visibility and requisition of each child up to date.
+   Returns TRUE if any of them changed. */
+static gboolean update_child_requisitions(WrapBox* this) {
+	WrapBoxChild* child;
+	GtkRequisition child_req;
+	gboolean visible;
+	gboolean changed = FALSE;
+
+	for (child = this->children; child; child = child->next) {
+		visible = GTK_WIDGET_VISIBLE(child->widget);
+		if (visible)
+			gtk_widget_size_request(child->widget, &child_req);
+		else
+			child_req.width = child_req.height = 0;
+
+		if (visible != child->visible ||
+				child_req.width != child->requisition.width ||
+				child_req.height != child->requisition.height) {
+			child->visible = visible;
+			child->requisition = child_req;
+			changed = TRUE;
+		}
+	}
+
+	return changed;
 }
 
 
 /* Get an upper bound on the number of possible columns. */
 static guint get_upper_bound_cols(WrapBox* this, guint optimal_width) {
 	WrapBoxChild* child;
-	GtkRequisition child_req;
 
 	gint width = 0;
 	guint cols = 0;
 
 	for (child = this->children; child; child = child->next) {
-		if (GTK_WIDGET_VISIBLE(child->widget)) {
+		if (child->visible) {
 
 			if (cols)
 				width += this->hspacing;
 
-			gtk_widget_size_request(child->widget, &child_req);
-			width += child_req.width;
+			width += child->requisition.width;
 
 			if (width <= optimal_width)
 				cols++;
@@ -618,7 +665,7 @@ static guint get_n_visible_children(WrapBox* this) {
 	
 
 	for (child = this->children; child; child = child->next) {
-		if (GTK_WIDGET_VISIBLE(child->widget))
+		if (child->visible)
 			n_visible_children++;
 	}
 
@@ -626,11 +673,12 @@ static guint get_n_visible_children(WrapBox* this) {
 }
 
 
-/* This is the smart size request; we try to maximize use of the width of the wrap box. */
+/* This is the smart size request; we try to maximize use of the width of the wrap box.
+   The result is cached, so if nothing but the state of the children has changed (e.g.
+   their selection) the columns don't have to be worked out again. */
 void wrap_box_size_request_optimal(GtkWidget* widget, GtkRequisition* requisition, guint optimal_width) {
 	WrapBox* this = WRAP_BOX(widget);
 	WrapBoxChild* child;
-	GtkRequisition child_req;
 
 	guint rows, row;
 	guint col_width;
@@ -643,6 +691,18 @@ void wrap_box_size_request_optimal(GtkWidget* widget, GtkRequisition* requisitio
 	guint col, cols;
 	guint16 n_visible_children;
 
+	/* Keep the last requisition until we're thawed. */
+	if (this->freeze_count)
+		return;
+
+	if (update_child_requisitions(this))
+		this->cache_valid = FALSE;
+	if (this->cache_valid && this->cached_width == optimal_width) {
+		*requisition = this->cached_requisition;
+		return;
+	}
+	this->cached_width = optimal_width;
+
 	/* Take into account the border. */
 	optimal_width -= GTK_CONTAINER(this)->border_width * 2;
 
@@ -663,12 +723,11 @@ void wrap_box_size_request_optimal(GtkWidget* widget, GtkRequisition* requisitio
 		/*g_printerr("__");*/
 		child = this->children;
 		while (child) {
-			if (GTK_WIDGET_VISIBLE(child->widget)) {
+			if (child->visible) {
 
 				row++;
 
-				gtk_widget_size_request(child->widget, &child_req);
-				child_width = child_req.width;
+				child_width = child->requisition.width;
 
 				/*g_printerr("{%d}", child_width);*/
 
@@ -677,7 +736,7 @@ void wrap_box_size_request_optimal(GtkWidget* widget, GtkRequisition* requisitio
 				if (row > 1)
 					col_height += this->vspacing;
 
-				col_height += child_req.height;
+				col_height += child->requisition.height;
 				col_width = MAX(col_width, child_width);
 
 				if (total_width + col_width > optimal_width) {
@@ -699,9 +758,9 @@ void wrap_box_size_request_optimal(GtkWidget* widget, GtkRequisition* requisitio
 						col_width = 0;
 						col_height = 0;
 					}
-					child = child->next;
 				}
 			}
+			child = child->next;
 		}
 		if (col_width) {
 			/*g_printerr("<%d>", col_height);*/
@@ -715,17 +774,19 @@ void wrap_box_size_request_optimal(GtkWidget* widget, GtkRequisition* requisitio
 	else {
 		/* Make the best of the situation -- request a long single column, even though we don't have the width. */
 		for (requisition->height = 0, row = 1, child = this->children; child; row++, child = child->next) {
-			if (GTK_WIDGET_VISIBLE(child->widget)) {
+			if (child->visible) {
 				if (row > 1)
 					requisition->height += this->vspacing;
-				gtk_widget_size_request(child->widget, &child_req);
-				requisition->height += child_req.height;
+				requisition->height += child->requisition.height;
 			}
 		}
 		requisition->height += GTK_CONTAINER(this)->border_width * 2;
 		requisition->width = optimal_width + GTK_CONTAINER(this)->border_width * 2;
 	}
 
+	this->cached_requisition = *requisition;
+	this->cache_valid = TRUE;
+
 	//g_printerr("(cols: %u, rows: %u, max_col: %u)", cols, rows, max_col_height);
 	//g_printerr("(req: width: %d, height: %d)", requisition->width, requisition->height);
 	//g_printerr("(optimal: %d)", optimal_width += GTK_CONTAINER(this)->border_width * 2);
@@ -738,17 +799,21 @@ void wrap_box_size_request_optimal(GtkWidget* widget, GtkRequisition* requisitio
 static void wrap_box_size_request(GtkWidget* widget, GtkRequisition* requisition) {
 	WrapBox* this = WRAP_BOX(widget);
 	WrapBoxChild* child;
-	GtkRequisition child_req;
 
 	guint width = 0, height = 0, row = 1;
 
+	if (this->freeze_count)
+		return;
+
+	if (update_child_requisitions(this))
+		this->cache_valid = FALSE;
+
 	for (child = this->children; child; row++, child = child->next) {
-		if (GTK_WIDGET_VISIBLE(child->widget)) {
+		if (child->visible) {
 			if (row > 1)
 				height += this->vspacing;
-			gtk_widget_size_request(child->widget, &child_req);
-			width = MAX(width, child_req.width);
-			height += child_req.height;
+			width = MAX(width, child->requisition.width);
+			height += child->requisition.height;
 		}
 	}
 
@@ -766,7 +831,7 @@ static GSList* reverse_list_col_children (WrapBox *wbox, WrapBoxChild **child_p,
 	*max_child_width = 0;
 
 	/* Get first visible child. */
-	while (child && !GTK_WIDGET_VISIBLE (child->widget)) {
+	while (child && !child->visible) {
 		*child_p = child->next;
 		child = *child_p;
 	}
@@ -775,7 +840,7 @@ static GSList* reverse_list_col_children (WrapBox *wbox, WrapBoxChild **child_p,
 		GtkRequisition child_requisition;
 		guint n = 1;
 
-		get_child_requisition (wbox, child->widget, &child_requisition);
+		get_child_requisition (wbox, child, &child_requisition);
 		height += child_requisition.height;
 		*max_child_width = MAX (*max_child_width, child_requisition.width);
 		slist = g_slist_prepend (slist, child);
@@ -783,8 +848,8 @@ static GSList* reverse_list_col_children (WrapBox *wbox, WrapBoxChild **child_p,
 		child = *child_p;
 
 		while (child && n < wbox->child_limit) {
-			if (GTK_WIDGET_VISIBLE (child->widget)) {
-				get_child_requisition (wbox, child->widget, &child_requisition);
+			if (child->visible) {
+				get_child_requisition (wbox, child, &child_requisition);
 				if (height + wbox->vspacing + child_requisition.height > col_height) {
 					/*g_printerr("[[stop at: %d]]", height + wbox->vspacing + child_requisition.height);*/
 					break;
@@ -819,7 +884,7 @@ static void layout_col(WrapBox *wbox, GtkAllocation *area, GSList *children, gui
 
 		n_children++;
 
-		get_child_requisition (wbox, child->widget, &child_requisition);
+		get_child_requisition (wbox, child, &child_requisition);
 		total_height += child_requisition.height;
 	}
 
@@ -866,7 +931,7 @@ static void layout_col(WrapBox *wbox, GtkAllocation *area, GSList *children, gui
 		child_allocation.x = area->x;
 		GtkRequisition child_requisition;
 
-		get_child_requisition (wbox, child->widget, &child_requisition);
+		get_child_requisition (wbox, child, &child_requisition);
 
 		if (child_requisition.width >= area->width)
 			child_allocation.width = area->width;
@@ -1015,6 +1080,11 @@ static void wrap_box_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
 	gint border = GTK_CONTAINER (wbox)->border_width;
 
 	widget->allocation = *allocation;
+
+	/* The children will be laid out when we're thawed. */
+	if (wbox->freeze_count)
+		return;
+
 	area.y = allocation->y + border;
 	area.x = allocation->x + border;
 	area.height = MAX (1, (gint) allocation->height - border * 2);
@@ -1027,3 +1097,22 @@ static void wrap_box_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
 }
 
 
+/* Hold off size negotiation while a batch of children is packed, removed or
+   changed.  Size requests return the last requisition and the children aren't
+   laid out until wrap_box_thaw(). */
+void wrap_box_freeze(WrapBox* wbox) {
+	g_return_if_fail(IS_WRAP_BOX(wbox));
+
+	wbox->freeze_count++;
+}
+
+
+/* Undo a wrap_box_freeze().  If that was the last one, queue a single resize
+   for everything that happened in the meantime. */
+void wrap_box_thaw(WrapBox* wbox) {
+	g_return_if_fail(IS_WRAP_BOX(wbox));
+	g_return_if_fail(wbox->freeze_count > 0);
+
+	if (--wbox->freeze_count == 0)
+		gtk_widget_queue_resize(GTK_WIDGET(wbox));
+}
@@ -58,6 +58,15 @@ struct _WrapBox {
 	guint16        n_children;
 	WrapBoxChild*  children;
 	guint          child_limit;
+
+	/* Size negotiation is held off while frozen (see wrap_box_freeze()). */
+	guint          freeze_count;
+
+	/* The last optimal size request, which stays good until a child is
+	   added, removed or resized. */
+	gboolean       cache_valid;
+	guint          cached_width;
+	GtkRequisition cached_requisition;
 };
 
 struct _WrapBoxClass {
@@ -68,6 +77,10 @@ struct _WrapBoxClass {
 struct _WrapBoxChild {
 	GtkWidget*  widget;
 
+	/* As of the last size request. */
+	gboolean       visible;
+	GtkRequisition requisition;
+
 	WrapBoxChild* next;
 };
 
@@ -87,6 +100,8 @@ void       wrap_box_pack(WrapBox *wbox, GtkWidget *child, gboolean do_resize);
 void       wrap_box_pack_pos(WrapBox* wbox, GtkWidget* child, guint pos, gboolean do_resize);
 void       wrap_box_reorder_child(WrapBox *wbox, GtkWidget *child, gint position);
 void       wrap_box_remove (GtkContainer *container, GtkWidget *widget, gboolean do_resize);
+void       wrap_box_freeze(WrapBox* wbox);
+void       wrap_box_thaw(WrapBox* wbox);
 
 G_END_DECLS
 
@@ -16,7 +16,6 @@
 	along with Viewglob; if not, write to the Free Software
 	Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
-
 #include "config.h"
 
 #include "common.h"
@@ -28,16 +27,33 @@
 #include <string.h>
 #include <ctype.h>
 
+#define GAP_LEN(cmd) ((cmd)->gap_end - (cmd)->gap_start)
+
+/* Whether byte b is the second or later byte of a UTF-8 character. */
+#define UTF8_CONT(b) (((guchar) (b) & 0xC0) == 0x80)
+
+static gchar    byte_at(const struct cmdline* cmd, gsize i);
+static gunichar char_at(const struct cmdline* cmd, gsize i);
+static gsize    next_char(const struct cmdline* cmd, gsize i);
+static gboolean prev_char(const struct cmdline* cmd, gsize i, gsize* prev);
+static void     gap_move(struct cmdline* cmd, gsize to);
+static void     gap_reserve(struct cmdline* cmd, gsize n);
+static void     replace_at_cursor(struct cmdline* cmd, gsize old_len,
+		const gchar* text, gsize text_len);
+
+
 /* Initialize working command line and sequence buffer. */
 void cmd_init(struct cmdline* cmd) {
 
 	gchar* lc_all;
 	gchar* lang;
 
-	cmd->data = g_string_sized_new(256);
+	cmd->size = 256;
+	cmd->buf = g_malloc(cmd->size + 1);
 	cmd->pos = 0;
 	cmd->rebuilding = FALSE;
 	cmd->expect_newline = FALSE;
+	cmd_clear(cmd);
 
 	cmd->pwd = NULL;
 	cmd->mask = g_string_new(NULL);
@@ -47,6 +63,7 @@ void cmd_init(struct cmdline* cmd) {
 	   cmd->pos is always treated as a byte offset, so some extra finagling
 	   must be done with UTF-8. */
 	cmd->is_utf8 = FALSE;
+	cmd->utf8_len = 0;
 	lc_all = getenv("LC_ALL");
 	lang = getenv("LANG");
 
@@ -71,39 +88,99 @@ void cmd_init(struct cmdline* cmd) {
 
 
 void cmd_free(struct cmdline* cmd) {
-	g_string_free(cmd->data, TRUE);
+	g_free(cmd->buf);
 }
 
 
 /* Start over from scratch (usually after a command has been executed). */
 gboolean cmd_clear(struct cmdline* cmd) {
 
-	cmd->data = g_string_truncate(cmd->data, 0);
+	cmd->len = 0;
+	cmd->changed = 0;
+	cmd->gap_start = 0;
+	cmd->gap_end = cmd->size;
+	cmd->buf[cmd->size] = '\0';
 	cmd->pos = 0;
 	return TRUE;
 }
 
 
+/* Get the command line as one string.  This closes up the gap, so it costs
+   as much as the distance from the last edit to the end of the line.  If
+   changed isn't NULL, it's set to the offset of the earliest edit since the
+   last call -- the text before that is as it was then. */
+const gchar* cmd_text(struct cmdline* cmd, gsize* changed) {
+	if (changed)
+		*changed = cmd->changed;
+	cmd->changed = cmd->len;
+
+	gap_move(cmd, cmd->len);
+	gap_reserve(cmd, 1);
+	cmd->buf[cmd->len] = '\0';
+	return cmd->buf;
+}
+
+
+/* Length of the command line in bytes. */
+gsize cmd_length(const struct cmdline* cmd) {
+	return cmd->len;
+}
+
+
+/* Find the nearest ^M before from (D_LEFT) or at or after it (D_RIGHT), and
+   return its offset, or -1 if there isn't one. */
+gint cmd_find_CR(const struct cmdline* cmd, gint from, enum direction dir) {
+	gsize i;
+	gchar* p;
+
+	g_return_val_if_fail(from >= 0, -1);
+
+	if (dir == D_LEFT) {
+		for (i = MIN((gsize) from, cmd->len); i > 0; i--) {
+			if (byte_at(cmd, i - 1) == '\015')
+				return i - 1;
+		}
+		return -1;
+	}
+
+	g_return_val_if_fail(dir == D_RIGHT, -1);
+
+	i = from;
+	if (i < cmd->gap_start) {
+		p = memchr(cmd->buf + i, '\015', cmd->gap_start - i);
+		if (p)
+			return p - cmd->buf;
+		i = cmd->gap_start;
+	}
+	if (i < cmd->len) {
+		p = memchr(cmd->buf + i + GAP_LEN(cmd), '\015', cmd->len - i);
+		if (p)
+			return p - cmd->buf - GAP_LEN(cmd);
+	}
+	return -1;
+}
+
+
 /* Determine whether there is whitespace to the left of the cursor. */
-gboolean cmd_whitespace_to_left(struct cmdline* cmd, gchar* holdover) {
+gboolean cmd_whitespace_to_left(struct cmdline* cmd, const gchar* holdover,
+		gsize ho_len) {
 	gboolean result;
+	gsize previous;
 
 	if ( (cmd->pos == 0) ||
 	     /* Kludge: if the shell buffer has a holdover, which consists
 			only of a space, it's reasonable to assume it won't
 			complete a sequence and will end up being added to the
 			command line. */
-			 (holdover && strlen(holdover) == 1 && *(holdover) == ' ') )
+			 (ho_len == 1 && *(holdover) == ' ') )
 		result = TRUE;
 	else {
 		if (cmd->is_utf8) {
-			gchar* previous = g_utf8_find_prev_char(
-					cmd->data->str, cmd->data->str + cmd->pos);
-
-			result = previous && g_unichar_isspace(g_utf8_get_char(previous));
+			result = prev_char(cmd, cmd->pos, &previous) &&
+				g_unichar_isspace(char_at(cmd, previous));
 		}
 		else
-			result = isspace( *(cmd->data->str + cmd->pos - 1) );
+			result = isspace(byte_at(cmd, cmd->pos - 1));
 	}
 
 	return result;
@@ -116,70 +193,46 @@ gboolean cmd_whitespace_to_left(struct cmdline* cmd, gchar* holdover) {
 gboolean cmd_whitespace_to_right(struct cmdline* cmd) {
 	gboolean result;
 
-	if (cmd->is_utf8) {
-		result = g_unichar_isspace(g_utf8_get_char(
-					cmd->data->str + cmd->pos));
-	}
+	if (cmd->is_utf8)
+		result = g_unichar_isspace(char_at(cmd, cmd->pos));
 	else
-		result = isspace( *(cmd->data->str + cmd->pos) );
+		result = isspace(byte_at(cmd, cmd->pos));
 
 	return result;
 }
 
 
 /* Overwrite the char in the working command line at pos in command;
-   realloc if necessary. */
+   grow it if necessary. */
 gboolean cmd_overwrite_char(struct cmdline* cmd, gchar c,
 		gboolean preserve_CR) {
 
 
 	if (preserve_CR) {
 		/* Preserve ^Ms. */
-			while (*(cmd->data->str + cmd->pos) == '\015')
+			while (byte_at(cmd, cmd->pos) == '\015')
 				cmd->pos++;
 	}
 
 	if (cmd->is_utf8) {
 		/* We examine each byte individually, but UTF-8 characters can be
-		   multibyte.  So conserve a string of characters until a valid
-		   UTF-8 char is created. */
-		static GString* utf8_char = NULL;
-		if (!utf8_char)
-			utf8_char = g_string_new(NULL);
-
-		utf8_char = g_string_append_c(utf8_char, c);
+		   multibyte.  So conserve the bytes until the character is
+		   complete, going by the length its first byte gives. */
+		cmd->utf8_char[cmd->utf8_len++] = c;
 
-		if (g_utf8_validate(utf8_char->str, utf8_char->len, NULL)) {
+		if (cmd->utf8_len >= g_utf8_skip[(guchar) cmd->utf8_char[0]]) {
 			/* The UTF-8 character has been completed and it's time to put it
-			   onto the command line. */
-
-			if (cmd->pos == cmd->data->len) {
-				/* We're at the end - just append the "character". */
-				cmd->data = g_string_append(cmd->data, utf8_char->str);
-			}
-			else {
-				/* We need to overwrite data.  Since the characters might not
-				   be the same length, erase the old one first and then insert
-				   the new one. */
-				gchar* next = g_utf8_next_char(cmd->data->str + cmd->pos);
-				gsize erase_len = next - (cmd->data->str + cmd->pos);
-				cmd->data = g_string_erase(cmd->data, cmd->pos, erase_len);
-				cmd->data = g_string_insert(cmd->data, cmd->pos,
-						utf8_char->str);
-			}
-
-			cmd->pos += utf8_char->len;
-			g_string_truncate(utf8_char, 0);
+			   onto the command line.  The characters might not be the same
+			   length, so replace the whole of the old one. */
+			gsize old_len = 0;
+			if (cmd->pos < cmd->len)
+				old_len = next_char(cmd, cmd->pos) - cmd->pos;
+			replace_at_cursor(cmd, old_len, cmd->utf8_char, cmd->utf8_len);
+			cmd->utf8_len = 0;
 		}
-
-	}
-	else {
-		if (cmd->pos == cmd->data->len)
-			cmd->data = g_string_append_c(cmd->data, c);
-		else
-			*(cmd->data->str + cmd->pos) = c;
-		cmd->pos++;
 	}
+	else
+		replace_at_cursor(cmd, cmd->pos < cmd->len ? 1 : 0, &c, 1);
 
 	action_queue(A_SEND_CMD);
 	return TRUE;
@@ -188,80 +241,68 @@ gboolean cmd_overwrite_char(struct cmdline* cmd, gchar c,
 
 /* Remove n chars from the working command line at cmd->pos. */
 gboolean cmd_del_chars(struct cmdline* cmd, gint n) {
+	gsize end;
 
 	g_return_val_if_fail(n >= 0, FALSE);
 
-
 	if (cmd->is_utf8) {
 		/* Erase n UTF-8 characters. */
-		int i;
+		gint i;
+		end = cmd->pos;
 		for (i = 0; i < n; i++) {
-			if ( *(cmd->data->str + cmd->pos) == '\0' ) {
+			if (end >= cmd->len) {
 				/* We've failed to keep up. */
 				action_queue(A_SEND_LOST);
 				return FALSE;
 			}
-			gchar* next = g_utf8_next_char(cmd->data->str + cmd->pos);
-			gsize erase_len = next - (cmd->data->str + cmd->pos);
-			cmd->data = g_string_erase(cmd->data, cmd->pos, erase_len);
+			end = next_char(cmd, end);
 		}
 	}
 	else {
-		if (cmd->pos + n > cmd->data->len) {
+		end = cmd->pos + n;
+		if (end > cmd->len) {
 			/* We've failed to keep up. */
 			action_queue(A_SEND_LOST);
 			return FALSE;
 		}
-
-		cmd->data = g_string_erase(cmd->data, cmd->pos, n);
 	}
 
+	gap_move(cmd, cmd->pos);
+	cmd->gap_end += end - cmd->pos;
+	cmd->len -= end - cmd->pos;
+	cmd->changed = MIN(cmd->changed, cmd->gap_start);
+
 	action_queue(A_SEND_CMD);
 	return TRUE;
 }
 
 
-/* Trash everything. */
+/* Trash everything.  ^M is a single byte in UTF-8 too, so the text can be
+   deleted by the byte either way. */
 gboolean cmd_wipe_in_line(struct cmdline* cmd, enum direction dir) {
-	gchar* CR_l;
-	gchar* CR_r;
-	int chars;
+	gint CR_l;
+	gint CR_r;
 
 	switch (dir) {
 
 		case D_RIGHT:	/* Clear to right (in this line) */
 
 			/* Find the ^M to the right. */
-			if (cmd->is_utf8) {
-				CR_r = g_utf8_strchr(
-						cmd->data->str + cmd->pos,
-						cmd->data->len - cmd->pos,
-						g_utf8_get_char("\015"));
-			}
-			else
-				CR_r = strchr(cmd->data->str + cmd->pos, '\015');
+			CR_r = cmd_find_CR(cmd, cmd->pos, D_RIGHT);
 
-			if (!CR_r) {
+			if (CR_r == -1) {
 				/* Erase everything to the right -- no ^Ms to take into
 				   account. */
-				cmd->data = g_string_truncate(cmd->data, cmd->pos);
-			}
-			else {
-				/* Erase to the right up to the first ^M. */
-				if (cmd->is_utf8) {
-					chars = g_utf8_pointer_to_offset(
-							cmd->data->str + cmd->pos, CR_r);
-				}
-				else
-					chars = (CR_r - cmd->data->str) - cmd->pos;
-
-				cmd_del_chars(cmd, chars);
-
-				/* If we were at pos 0, this is the new pos 0; delete the
-				   CR. */
-				if (cmd->pos == 0)
-					cmd_del_chars(cmd, 1);
+				CR_r = cmd->len;
 			}
+
+			/* Erase to the right up to the first ^M. */
+			replace_at_cursor(cmd, CR_r - cmd->pos, "", 0);
+
+			/* If we were at pos 0, this is the new pos 0; delete the
+			   CR. */
+			if (cmd->pos == 0 && cmd->len > 0)
+				replace_at_cursor(cmd, 1, "", 0);
 			break;
 
 		case D_LEFT:	/* Clear to left -- I've never seen this happen. */
@@ -270,39 +311,18 @@ gboolean cmd_wipe_in_line(struct cmdline* cmd, enum direction dir) {
 
 		case D_ALL:	/* Clear all (in this line). */
 
-			/* Find the ^M to the right. */
-			if (cmd->is_utf8) {
-				CR_r = g_utf8_strchr(
-						cmd->data->str + cmd->pos,
-						cmd->data->len - cmd->pos,
-						g_utf8_get_char("\015"));
-			}
-			else
-				CR_r = strchr(cmd->data->str + cmd->pos, '\015');
-
-			if (!CR_r)
-				CR_r = cmd->data->str + cmd->data->len;
-			
-			/* Find the ^M to the left. */
-			if (cmd->is_utf8) {
-				CR_l = g_utf8_strrchr(cmd->data->str, cmd->pos,
-						g_utf8_get_char("\015"));
-			}
-			else
-				CR_l = g_strrstr_len(cmd->data->str, cmd->pos, "\015");
+			/* Find the ^Ms to either side. */
+			CR_r = cmd_find_CR(cmd, cmd->pos, D_RIGHT);
+			if (CR_r == -1)
+				CR_r = cmd->len;
 
-			if (!CR_l)
-				CR_l = cmd->data->str;
+			CR_l = cmd_find_CR(cmd, cmd->pos, D_LEFT);
+			if (CR_l == -1)
+				CR_l = 0;
 
 			/* Delete everything in-between. */
-			cmd->pos = CR_l - cmd->data->str;
-
-			if (cmd->is_utf8)
-				chars = g_utf8_pointer_to_offset(CR_l, CR_r);
-			else 
-				chars = CR_r - CR_l;
-
-			cmd_del_chars(cmd, chars);
+			cmd->pos = CR_l;
+			replace_at_cursor(cmd, CR_r - CR_l, "", 0);
 
 			break;
 
@@ -326,9 +346,14 @@ gboolean cmd_insert_chars(struct cmdline* cmd, gchar c, gint n) {
 		return FALSE;
 	}
 
-	int i;
-	for (i = 0; i < n; i++)
-		cmd->data = g_string_insert_c(cmd->data, cmd->pos, c);
+	/* The cursor stays where it is, so the new chars go at the far side of
+	   the gap. */
+	gap_move(cmd, cmd->pos);
+	gap_reserve(cmd, n);
+	cmd->gap_end -= n;
+	memset(cmd->buf + cmd->gap_end, c, n);
+	cmd->len += n;
+	cmd->changed = MIN(cmd->changed, cmd->gap_start);
 
 	action_queue(A_SEND_CMD);
 	return TRUE;
@@ -342,14 +367,16 @@ gboolean cmd_insert_chars(struct cmdline* cmd, gchar c, gint n) {
    than the sickness, but it seems to work all right. */
 void cmd_del_trailing_CRs(struct cmdline* cmd) {
 	/* This should be safe for UTF-8 as well. */
-	gint temp;
-	while (cmd->data->len &&
-			cmd->data->str[cmd->data->len - 1] == '\015' &&
-			cmd->pos < cmd->data->len - 1) {
-		temp = cmd->pos;
-		cmd->pos = cmd->data->len - 1;
-		cmd_del_chars(cmd, 1);
-		cmd->pos = temp;
+	while (cmd->len &&
+			byte_at(cmd, cmd->len - 1) == '\015' &&
+			cmd->pos < cmd->len - 1) {
+		/* Trim it off the end without moving the gap. */
+		if (cmd->gap_start == cmd->len)
+			cmd->gap_start--;
+		cmd->len--;
+		cmd->buf[cmd->len + GAP_LEN(cmd)] = '\0';
+		cmd->changed = MIN(cmd->changed, cmd->len);
+		action_queue(A_SEND_CMD);
 	}
 }
 
@@ -390,21 +417,18 @@ gboolean cmd_forward(struct cmdline* cmd, gint n, gboolean do_it) {
 
 	if (cmd->is_utf8) {
 		gint i;
-		gint new_pos = cmd->pos;
+		gsize new_pos = cmd->pos;
 		for (i = 0; i < n; i++) {
-			if ( *(cmd->data->str + new_pos) == '\0'
-					|| new_pos > cmd->data->len) {
+			if (new_pos >= cmd->len)
 				return FALSE;
-			}
-			gchar* next = g_utf8_next_char(cmd->data->str + new_pos);
-			new_pos = next - cmd->data->str;
+			new_pos = next_char(cmd, new_pos);
 		}
 		if (do_it)
 			cmd->pos = new_pos;
 	}
 	else {
 		/* Just need to shift by n. */
-		if (cmd->pos + n <= cmd->data->len) {
+		if (cmd->pos + n <= cmd->len) {
 			if (do_it)
 				cmd->pos += n;
 		}
@@ -423,14 +447,10 @@ gboolean cmd_backward(struct cmdline* cmd, gint n, gboolean do_it) {
 
 	if (cmd->is_utf8) {
 		gint i;
-		gint new_pos = cmd->pos;
+		gsize new_pos = cmd->pos;
 		for (i = 0; i < n; i++) {
-			gchar* prev = g_utf8_find_prev_char(cmd->data->str,
-					cmd->data->str + new_pos);
-			if (!prev)
+			if (!prev_char(cmd, new_pos, &new_pos))
 				return FALSE;
-
-			new_pos = prev - cmd->data->str;
 		}
 		if (do_it)
 			cmd->pos = new_pos;
@@ -448,3 +468,104 @@ gboolean cmd_backward(struct cmdline* cmd, gint n, gboolean do_it) {
 	return TRUE;
 }
 
+
+/* The byte at offset i in the text.  Just past the end, this is '\0'. */
+static gchar byte_at(const struct cmdline* cmd, gsize i) {
+	if (i < cmd->gap_start)
+		return cmd->buf[i];
+	else
+		return cmd->buf[i + GAP_LEN(cmd)];
+}
+
+
+/* The UTF-8 character starting at offset i. */
+static gunichar char_at(const struct cmdline* cmd, gsize i) {
+	gchar bytes[7];
+	gint n = 0;
+
+	while (n < 6 && i + n < cmd->len) {
+		bytes[n] = byte_at(cmd, i + n);
+		n++;
+	}
+	bytes[n] = '\0';
+	return g_utf8_get_char(bytes);
+}
+
+
+/* Offset of the UTF-8 character following the one at i. */
+static gsize next_char(const struct cmdline* cmd, gsize i) {
+	return MIN(i + g_utf8_skip[(guchar) byte_at(cmd, i)], cmd->len);
+}
+
+
+/* Find the start of the UTF-8 character before offset i, as
+   g_utf8_find_prev_char() would. */
+static gboolean prev_char(const struct cmdline* cmd, gsize i, gsize* prev) {
+	while (i > 0) {
+		i--;
+		if (!UTF8_CONT(byte_at(cmd, i))) {
+			*prev = i;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+
+/* Move the gap so that it starts at offset to. */
+static void gap_move(struct cmdline* cmd, gsize to) {
+	gsize n;
+
+	to = MIN(to, cmd->len);
+
+	if (to < cmd->gap_start) {
+		n = cmd->gap_start - to;
+		memmove(cmd->buf + cmd->gap_end - n, cmd->buf + to, n);
+		cmd->gap_start -= n;
+		cmd->gap_end -= n;
+	}
+	else if (to > cmd->gap_start) {
+		n = to - cmd->gap_start;
+		memmove(cmd->buf + cmd->gap_start, cmd->buf + cmd->gap_end, n);
+		cmd->gap_start += n;
+		cmd->gap_end += n;
+	}
+}
+
+
+/* Make sure the gap has room for at least n bytes.  The buffer is doubled,
+   so that growing it is amortized over the edits. */
+static void gap_reserve(struct cmdline* cmd, gsize n) {
+	gsize after, new_size;
+
+	if (GAP_LEN(cmd) >= n)
+		return;
+
+	new_size = MAX(cmd->size * 2, cmd->len + n);
+	after = cmd->len - cmd->gap_start;
+
+	/* Slide the text after the gap (and its '\0') up to the new end. */
+	cmd->buf = g_realloc(cmd->buf, new_size + 1);
+	memmove(cmd->buf + new_size - after, cmd->buf + cmd->gap_end, after + 1);
+	cmd->gap_end = new_size - after;
+	cmd->size = new_size;
+}
+
+
+/* Replace the old_len bytes under the cursor with text, and
+   leave the cursor just past them. */
+static void replace_at_cursor(struct cmdline* cmd, gsize old_len,
+		const gchar* text, gsize text_len) {
+
+	gap_move(cmd, cmd->pos);
+	cmd->gap_end += old_len;
+	cmd->len -= old_len;
+	cmd->changed = MIN(cmd->changed, cmd->gap_start);
+
+	gap_reserve(cmd, text_len);
+	memcpy(cmd->buf + cmd->gap_start, text, text_len);
+	cmd->gap_start += text_len;
+	cmd->len += text_len;
+	cmd->pos = cmd->gap_start;
+}
+
@@ -25,9 +25,18 @@
 G_BEGIN_DECLS
 
 
+/* The command line is kept in a gap buffer: the text before the gap, some
+   unused space, then the text after it.  The gap is moved to the cursor
+   when there's an edit to make, so typing or deleting in the middle of a
+   long line only costs as much as the cursor has moved since last time. */
 struct cmdline {
-	GString* data;
-	gint pos;
+	gchar* buf;
+	gsize size;       /* Allocated, not counting room for a '\0'. */
+	gsize len;        /* Length of the text itself. */
+	gsize gap_start;
+	gsize gap_end;
+	gint pos;         /* Cursor, as a byte offset into the text. */
+	gsize changed;    /* Earliest edit since cmd_text() was last called. */
 	gboolean rebuilding;
 	gboolean expect_newline;
 
@@ -36,6 +45,8 @@ struct cmdline {
 	GString* mask_final;
 
 	gboolean is_utf8;
+	gchar utf8_char[6];   /* Bytes of a UTF-8 character still arriving. */
+	gint utf8_len;
 };
 
 
@@ -46,7 +57,13 @@ void cmd_init(struct cmdline* cmd);
 void cmd_free(struct cmdline* cmd);
 gboolean cmd_clear(struct cmdline* cmd);
 
-gboolean cmd_whitespace_to_left(struct cmdline* cmd, gchar* holdover);
+const gchar* cmd_text(struct cmdline* cmd, gsize* changed);
+gsize        cmd_length(const struct cmdline* cmd);
+gint         cmd_find_CR(const struct cmdline* cmd, gint from,
+		enum direction dir);
+
+gboolean cmd_whitespace_to_left(struct cmdline* cmd, const gchar* holdover,
+		gsize ho_len);
 gboolean cmd_whitespace_to_right(struct cmdline* cmd);
 
 gboolean cmd_overwrite_char(struct cmdline* cmd, gchar c,
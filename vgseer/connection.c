@@ -24,6 +24,15 @@
 
 #include <string.h>
 
+/* A stretch of the buffer that was eaten. */
+struct cut {
+	gsize start;
+	gsize end;
+};
+
+/* Most spans handed to writev() at once (well under IOV_MAX). */
+#define MAX_IOV 64
+
 
 /* Initialize the given Connection. */
 void connection_init(Connection* cnct, gchar* name, int fd_in, int fd_out,
@@ -45,7 +54,8 @@ void connection_init(Connection* cnct, gchar* name, int fd_in, int fd_out,
 	cnct->seglen = 0;
 	cnct->pl = pl;
 	cnct->status = MS_NO_MATCH;
-	cnct->holdover = NULL;
+	cnct->cuts = g_array_new(FALSE, FALSE, sizeof(struct cut));
+	cnct->ho_len = 0;
 	cnct->ho_written = FALSE;
 	cnct->skip = 0;
 
@@ -54,42 +64,37 @@ void connection_init(Connection* cnct, gchar* name, int fd_in, int fd_out,
 }
 
 
-/* Free the read/write and holdover buffers. */
+/* Free the cut list.  The buffer belongs to the caller. */
 void connection_free(Connection* cnct) {
 
 	g_return_if_fail(cnct != NULL);
 
-	if (cnct->holdover) {
-		g_free(cnct->holdover);
-		cnct->holdover = NULL;
-	}
+	g_array_free(cnct->cuts, TRUE);
+	cnct->cuts = NULL;
 }
 
 
-/* Prepend the holdover from the last read onto the beginning
-   of the current buffer. If there is no holdover, just initialize the
-   offsets. */
+/* Move the holdover from the last read to the beginning of the buffer,
+   ahead of the next read.  It's at most one unfinished sequence.  If there
+   is no holdover, just initialize the offsets. */
 void prepend_holdover(Connection* b) {
 
 	g_return_if_fail(b != NULL);
 
-	if (b->holdover) {
-		size_t ho_len;
-		ho_len = strlen(b->holdover);
+	b->cuts = g_array_set_size(b->cuts, 0);
 
-		/* Copy over the holdover and then free it. */
-		memcpy(b->buf, b->holdover, ho_len);
-		g_free(b->holdover);
-		b->holdover = NULL;
+	if (b->ho_len) {
+		memmove(b->buf, b->buf + b->pos, b->ho_len);
 
-		b->filled = ho_len;
+		b->filled = b->ho_len;
 		b->pos = 0;
 		/* b->seglen has not changed since the create_holdover(). */
 
 		if (b->ho_written)
-			b->skip = ho_len;
+			b->skip = b->ho_len;
 		else
 			b->skip = 0;
+		b->ho_len = 0;
 	}
 	else {
 		b->filled = 0;
@@ -100,45 +105,44 @@ void prepend_holdover(Connection* b) {
 }
 
 
-/* Cut the segment under investigation into a holdover, to be prepended to
-   a later buffer. */
+/* Hold the segment under investigation (the tail of the buffer) over, to
+   be looked at again with the next read.  It stays where it is until
+   then. */
 void create_holdover(Connection* b, gboolean write_later) {
 
 	g_return_if_fail(b != NULL);
-	g_return_if_fail(b->holdover == NULL);
+	g_return_if_fail(b->ho_len == 0);
 
-	/* Copy as null-terminated string. */
-	b->holdover = g_strndup(b->buf + b->pos, b->seglen);
+	b->ho_len = b->seglen;
 
-	if (write_later) {
-		/* Writing of this segment is postponed until after the next buffer
-		   read. */
-		b->filled -= b->seglen;
-		b->ho_written = FALSE;
-	}
-	else
-		b->ho_written = TRUE;
+	/* Otherwise writing of this segment is postponed until after the next
+	   buffer read. */
+	b->ho_written = !write_later;
 }
 
 
-/* Remove the segment under investigation from the buffer. */
+/* Remove the segment under investigation from the output.  Rather than
+   closing the gap, remember it, and leave it out of the write. */
 void eat_segment(Connection* b) {
 
 	g_return_if_fail(b != NULL);
 
-	char* start;
-	char* end;
-	size_t length;
+	struct cut* last;
+	struct cut c;
 
-	start = b->buf + b->pos;
-	end = b->buf + b->pos + b->seglen + 1;
-	length = b->filled - (b->pos + b->seglen + 1);
+	c.start = b->pos;
+	c.end = b->pos + b->seglen + 1;
 
-	memmove(start, end, length);
+	/* Eaten keys tend to come in a row. */
+	last = b->cuts->len ?
+		&g_array_index(b->cuts, struct cut, b->cuts->len - 1) : NULL;
+	if (last && last->end == c.start)
+		last->end = c.end;
+	else
+		b->cuts = g_array_append_val(b->cuts, c);
 
-	b->filled -= b->seglen + 1;
+	b->pos = c.end;
 	b->seglen = 0;
-	/* b->pos is in the right spot because of the eat. */
 }
 
 
@@ -193,31 +197,64 @@ gboolean connection_read(Connection* cnct) {
 }
 
 
-/* Write out the full (filled) buffer. */
-gboolean connection_write(Connection* cnct) {
+/* The n'th stretch of the buffer to be written, as offsets: what's
+   between the eaten segments, and short of a holdover that's to be
+   written later.  Returns FALSE when there are no more.  Stretches may be
+   empty. */
+gboolean connection_span(const Connection* b, guint n, gsize* start,
+		gsize* end) {
 
-	g_return_val_if_fail(cnct != NULL, FALSE);
+	g_return_val_if_fail(b != NULL, FALSE);
+	g_return_val_if_fail(start != NULL, FALSE);
+	g_return_val_if_fail(end != NULL, FALSE);
 
-	gboolean ok = TRUE;
+	gsize limit = b->filled - (b->ho_written ? 0 : b->ho_len);
+
+	if (n > b->cuts->len)
+		return FALSE;
+
+	*start = n ? g_array_index(b->cuts, struct cut, n - 1).end : 0;
+	*end = n < b->cuts->len ?
+		g_array_index(b->cuts, struct cut, n).start : limit;
 
-	if (cnct->filled) { 
-		switch (write_all(cnct->fd_out, cnct->buf + cnct->skip,
-					cnct->filled - cnct->skip)) {
+	*start = MIN(*start, limit);
+	*end = MIN(*end, limit);
+	return TRUE;
+}
+
+
+/* Write out the filled buffer, less the eaten segments. */
+gboolean connection_write(Connection* cnct) {
 
-			case IOR_OK:
-				break;
+	g_return_val_if_fail(cnct != NULL, FALSE);
 
-			case IOR_ERROR:
+	struct iovec vec[MAX_IOV];
+	gint count = 0;
+	gsize start, end;
+	guint n;
+	gboolean more = TRUE;
+
+	for (n = 0; more; n++) {
+		more = connection_span(cnct, n, &start, &end);
+		if (more) {
+			start = MAX(start, cnct->skip);
+			if (start >= end)
+				continue;
+			vec[count].iov_base = cnct->buf + start;
+			vec[count].iov_len = end - start;
+			count++;
+		}
+
+		if (count == MAX_IOV || (!more && count > 0)) {
+			if (writev_all(cnct->fd_out, vec, count) != IOR_OK) {
 				g_critical("Problem writing for %s: %s", cnct->name,
 						g_strerror(errno));
-				ok = FALSE;
-				break;
-
-			default:
-				g_return_val_if_reached(FALSE);
+				return FALSE;
+			}
+			count = 0;
 		}
 	}
 
-	return ok;
+	return TRUE;
 }
 
@@ -56,7 +56,9 @@ struct _Connection {
 	gsize seglen;           /* Length of the examined segment. */
 	enum process_level pl;  /* Processing level of the buffer. */
 	MatchStatus status;     /* Result of the last check_seqs() attempt. */
-	gchar* holdover;        /* Segment leftover from the last read. */
+	GArray* cuts;           /* Eaten segments, which aren't written. */
+	gsize ho_len;           /* Length of the segment at pos held over for
+	                           the next read (0 if none). */
 	gboolean ho_written;    /* The holdover was written already (and thus
 	                           should be skipped. */
 	gsize skip;             /* Number of bytes to skip writing (already
@@ -72,6 +74,8 @@ void prepend_holdover(Connection* b);
 void create_holdover(Connection* b, gboolean write_later);
 void eat_segment(Connection* b);
 void pass_segment(Connection* b);
+gboolean connection_span(const Connection* b, guint n, gsize* start,
+		gsize* end);
 gboolean connection_read(Connection* cnct);
 gboolean connection_write(Connection* cnct);
 
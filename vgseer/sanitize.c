@@ -31,22 +31,40 @@ enum quote_type {
 };
 
 
-struct quote_list {
-	enum quote_type qt;
-	struct quote_list* next;
-};
+/* Quotes (and extglob parens) can be nested this deep.  Past that, the rest
+   of the command line is left out. */
+#define QUOTE_DEPTH 64
 
 
+/* All the lexer's state, so that a copy of it can be taken as a
+   checkpoint. */
 struct sane_cmd {
 	gboolean last_char_backslash;
 	gboolean last_char_exclamation;
 	gboolean last_char_dollar;
 	gboolean skip_word;
-	struct quote_list* ql;
+	gchar ql[QUOTE_DEPTH];     /* Stack of enum quote_type. */
+	gint ql_len;
+	gboolean done;             /* Nothing more is to be taken. */
+	gsize in;                  /* How far through the string it's got. */
+	gsize out;                 /* Length of command at a checkpoint. */
+	GString* command;
+	GArray* checkpoints;
+};
+
+
+/* The checkpoints are taken after each space or tab, and each is good for as
+   long as the string up to it and the output up to it stay the same. */
+struct sanitizer {
+	struct sane_cmd s;
 	GString* command;
+	GArray* checkpoints;
 };
 
 
+static void       lex(struct sane_cmd* s, const gchar* string, gsize len);
+static gchar*     finish(struct sane_cmd* s);
+
 static void       add_char(struct sane_cmd* s, gchar c);
 static void       delete_current_word(struct sane_cmd* s);
 static void       backspace(struct sane_cmd* s);
@@ -54,219 +72,286 @@ static gboolean   last_char(struct sane_cmd* s, gchar c);
 
 static gboolean         in_quote(struct sane_cmd* s, enum quote_type qt);
 static enum quote_type  ql_pop(struct sane_cmd* s);
-static void             ql_push(struct sane_cmd* s, enum quote_type);
+static gboolean         ql_push(struct sane_cmd* s, enum quote_type);
 
 
-gchar* sanitize(GString* string) {
-	struct sane_cmd s;
-	gint i;
-	gchar c;
+struct sanitizer* sanitizer_new(void) {
+	struct sanitizer* z;
+
+	z = g_new(struct sanitizer, 1);
+	z->command = g_string_new(NULL);
+	z->checkpoints = g_array_new(FALSE, FALSE, sizeof(struct sane_cmd));
+	return z;
+}
+
+
+void sanitizer_free(struct sanitizer* z) {
+	g_return_if_fail(z != NULL);
+
+	g_string_free(z->command, TRUE);
+	g_array_free(z->checkpoints, TRUE);
+	g_free(z);
+}
+
+
+/* Sanitize string, which is the same as last time z was used up to offset
+   changed.  Only the part from the last checkpoint before that on has to be
+   gone over again. */
+gchar* sanitize_from(struct sanitizer* z, const gchar* string, gsize len,
+		gsize changed) {
+	struct sane_cmd* cp;
+
+	g_return_val_if_fail(z != NULL, NULL);
+	g_return_val_if_fail(string != NULL, NULL);
+
+	/* Drop the checkpoints the change has overtaken. */
+	changed = MIN(changed, len);
+	while (z->checkpoints->len > 0) {
+		cp = &g_array_index(z->checkpoints, struct sane_cmd,
+				z->checkpoints->len - 1);
+		if (cp->in <= changed)
+			break;
+		g_array_set_size(z->checkpoints, z->checkpoints->len - 1);
+	}
+
+	if (z->checkpoints->len > 0) {
+		z->s = g_array_index(z->checkpoints, struct sane_cmd,
+				z->checkpoints->len - 1);
+	}
+	else {
+		z->s.last_char_backslash = FALSE;
+		z->s.last_char_exclamation = FALSE;
+		z->s.last_char_dollar = FALSE;
+		z->s.skip_word = FALSE;
+		z->s.ql_len = 0;
+		z->s.done = FALSE;
+		z->s.in = 0;
+		z->s.out = 0;
+	}
+	z->s.command = g_string_truncate(z->command, z->s.out);
+	z->s.checkpoints = z->checkpoints;
+
+	lex(&z->s, string, len);
 
-	s.last_char_backslash = FALSE;
-	s.last_char_exclamation = FALSE;
-	s.last_char_dollar = FALSE;
-	s.skip_word = FALSE;
-	s.command = g_string_sized_new(string->len);
-	s.ql = NULL;
+	return finish(&z->s);
+}
+
+
+gchar* sanitize(const gchar* string, gsize len) {
+	struct sanitizer* z;
+	gchar* retval;
+
+	z = sanitizer_new();
+	retval = sanitize_from(z, string, len, 0);
+	sanitizer_free(z);
+	return retval;
+}
 
-	for (i = 0; i < string->len; i++) {
-		c = *(string->str + i);
 
-		if (s.last_char_exclamation) {
+/* Go over string from s->in on, until the end or until there's nothing more
+   that can be taken from it. */
+static void lex(struct sane_cmd* s, const gchar* string, gsize len) {
+	gchar c;
+
+	while (s->in < len && !s->done) {
+		c = *(string + s->in);
+		s->in++;
+
+		if (s->last_char_exclamation) {
 			/* Don't allow history expansion. */
 			if ( (c != '(') && (c != ' ') && (c != '\t') && (c != '\n') ) {
-				s.skip_word = TRUE;
-				s.last_char_exclamation = FALSE;
+				s->skip_word = TRUE;
+				s->last_char_exclamation = FALSE;
 				/* Remove the ! */
-				backspace(&s);
+				backspace(s);
 				continue;
 			}
 		}
-		else if (s.last_char_dollar) {
+		else if (s->last_char_dollar) {
 			/* Don't allow $ constructs (variables, command substitution,
 			   etc. */
 			if ( (c != ' ') && (c != '\t') && (c != '\n') ) {
-				backspace(&s);
-				s.last_char_dollar = FALSE;
-				i = string->len;   /* Break out of loop. */
+				backspace(s);
+				s->last_char_dollar = FALSE;
+				s->done = TRUE;
 				continue;
 			}
 			else {
 				/* A lone $ is acceptable. */
-				s.last_char_dollar = FALSE;
+				s->last_char_dollar = FALSE;
 			}
 		}
 
-		if (s.skip_word) {
+		if (s->skip_word) {
 			if ( (c == ' ') || (c == '\t') )
-				s.skip_word = FALSE;
+				s->skip_word = FALSE;
 			else
 				continue;
 		}
 
 		switch (c) {
 			case ('\''):
-				if (in_quote(&s, QT_SINGLE)) {
-					ql_pop(&s);
-					add_char(&s, c);
+				if (in_quote(s, QT_SINGLE)) {
+					ql_pop(s);
+					add_char(s, c);
 				}
-				else if (in_quote(&s, QT_DOUBLE))
-					add_char(&s, c);
-				else if (s.last_char_backslash) {
-					s.last_char_backslash = FALSE;
-					add_char(&s, c);
+				else if (in_quote(s, QT_DOUBLE))
+					add_char(s, c);
+				else if (s->last_char_backslash) {
+					s->last_char_backslash = FALSE;
+					add_char(s, c);
 				}
 				else {
-					ql_push(&s, QT_SINGLE);
-					add_char(&s, c);
+					if (ql_push(s, QT_SINGLE))
+						add_char(s, c);
 				}
 				break;
 
 			case ('\"'):
-				if (in_quote(&s, QT_SINGLE))
-					add_char(&s, c);
-				else if (in_quote(&s, QT_DOUBLE)) {
-					ql_pop(&s);
-					add_char(&s, c);
+				if (in_quote(s, QT_SINGLE))
+					add_char(s, c);
+				else if (in_quote(s, QT_DOUBLE)) {
+					ql_pop(s);
+					add_char(s, c);
 				}
-				else if (s.last_char_backslash) {
-					s.last_char_backslash = FALSE;
-					add_char(&s, c);
+				else if (s->last_char_backslash) {
+					s->last_char_backslash = FALSE;
+					add_char(s, c);
 				}
 				else {
-					ql_push(&s, QT_DOUBLE);
-					add_char(&s, c);
+					if (ql_push(s, QT_DOUBLE))
+						add_char(s, c);
 				}
 				break;
 
 			case ('\\'):
-				if (in_quote(&s, QT_SINGLE) || in_quote(&s, QT_DOUBLE))
-					add_char(&s, c);
-				else if (s.last_char_backslash) {
-					s.last_char_backslash = FALSE;
-					add_char(&s, c);
+				if (in_quote(s, QT_SINGLE) || in_quote(s, QT_DOUBLE))
+					add_char(s, c);
+				else if (s->last_char_backslash) {
+					s->last_char_backslash = FALSE;
+					add_char(s, c);
 				}
 				else {
-					s.last_char_backslash = TRUE;
-					add_char(&s, c);
+					s->last_char_backslash = TRUE;
+					add_char(s, c);
 				}
 				break;
 
 			case ('$'):
-				if (in_quote(&s, QT_SINGLE))
-					add_char(&s, c);
-				else if (s.last_char_backslash) {
-					s.last_char_backslash = FALSE;
-					add_char(&s, c);
+				if (in_quote(s, QT_SINGLE))
+					add_char(s, c);
+				else if (s->last_char_backslash) {
+					s->last_char_backslash = FALSE;
+					add_char(s, c);
 				}
 				else {
-					s.last_char_dollar = TRUE;
-					add_char(&s, c);
+					s->last_char_dollar = TRUE;
+					add_char(s, c);
 				}
 
 				break;
 
 
 			case ('!'):      /* Gotta be careful about history expansion. */
-				if (in_quote(&s, QT_SINGLE))
-					add_char(&s, c);
-				else if (in_quote(&s, QT_EXTGLOB_PAREN))
+				if (in_quote(s, QT_SINGLE))
+					add_char(s, c);
+				else if (in_quote(s, QT_EXTGLOB_PAREN))
 					/* No ! allowed in ?( ) constructs. */
 					break;
-				else if (s.last_char_backslash) {
-					s.last_char_backslash = FALSE;
-					add_char(&s, c);
+				else if (s->last_char_backslash) {
+					s->last_char_backslash = FALSE;
+					add_char(s, c);
 				}
 				else {
-					s.last_char_exclamation = TRUE;
-					add_char(&s, c);
+					s->last_char_exclamation = TRUE;
+					add_char(s, c);
 				}
 				break;
 
 			case (' '):
 			case ('\t'):
-				if (s.last_char_exclamation)
-					s.last_char_exclamation = FALSE;
-				else if (s.last_char_backslash)
-					s.last_char_backslash = FALSE;
-				else if (s.skip_word) {
+				if (s->last_char_exclamation)
+					s->last_char_exclamation = FALSE;
+				else if (s->last_char_backslash)
+					s->last_char_backslash = FALSE;
+				else if (s->skip_word) {
 					/* Only ' ' and \t can turn off skip_word. */
-					s.skip_word = FALSE;
+					s->skip_word = FALSE;
 				}
-				add_char(&s, c);
+				add_char(s, c);
 				break;
 
 			/* Only allow ( in the *(blah), ?(blah), etc. forms, or when
 			   quoted. */
 			case ('('):
-				if (in_quote(&s, QT_SINGLE))
-					add_char(&s, c);
-				else if (s.last_char_backslash) {
-					s.last_char_backslash = FALSE;
-					add_char(&s, c);
+				if (in_quote(s, QT_SINGLE))
+					add_char(s, c);
+				else if (s->last_char_backslash) {
+					s->last_char_backslash = FALSE;
+					add_char(s, c);
 				}
-				else if (s.last_char_exclamation) {
-					if (in_quote(&s, QT_DOUBLE)) {
+				else if (s->last_char_exclamation) {
+					if (in_quote(s, QT_DOUBLE)) {
 						/* It sucks that ! is such a multiuse character.
 						   There's no good way to deal here, so just give
 						   up. */
-						backspace(&s);
-						s.last_char_exclamation = FALSE;
-						i = string->len;
+						backspace(s);
+						s->last_char_exclamation = FALSE;
+						s->done = TRUE;
 						break;
 					}
-					s.last_char_exclamation = FALSE;
-					ql_push(&s, QT_EXTGLOB_PAREN);
-					add_char(&s, c);
+					s->last_char_exclamation = FALSE;
+					if (ql_push(s, QT_EXTGLOB_PAREN))
+						add_char(s, c);
 				}
-				else if (in_quote(&s, QT_DOUBLE))
-					add_char(&s, c);
-				else if (last_char(&s, '?') || last_char(&s, '*') ||
-				         last_char(&s, '+') || last_char(&s, '@')) {
-					ql_push(&s, QT_EXTGLOB_PAREN);
-					add_char(&s, c);
+				else if (in_quote(s, QT_DOUBLE))
+					add_char(s, c);
+				else if (last_char(s, '?') || last_char(s, '*') ||
+				         last_char(s, '+') || last_char(s, '@')) {
+					if (ql_push(s, QT_EXTGLOB_PAREN))
+						add_char(s, c);
 				}
 				else
-					i = string->len;    /* Break out of loop. */
+					s->done = TRUE;
 				break;
 
 			case (')'):
-				if (in_quote(&s, QT_SINGLE) || in_quote(&s, QT_DOUBLE))
-					add_char(&s, c);
-				else if (s.last_char_backslash) {
-					s.last_char_backslash = FALSE;
-					add_char(&s, c);
+				if (in_quote(s, QT_SINGLE) || in_quote(s, QT_DOUBLE))
+					add_char(s, c);
+				else if (s->last_char_backslash) {
+					s->last_char_backslash = FALSE;
+					add_char(s, c);
 				}
-				else if (in_quote(&s, QT_EXTGLOB_PAREN)) {
-					ql_pop(&s);
-					add_char(&s, c);
+				else if (in_quote(s, QT_EXTGLOB_PAREN)) {
+					ql_pop(s);
+					add_char(s, c);
 				}
 				/* Skip ) otherwise. */
 				break;
 
 			case ('`'):  /* Backtick */
-				if (in_quote(&s, QT_SINGLE))
-					add_char(&s, c);
-				else if (s.last_char_backslash) {
-					s.last_char_backslash = FALSE;
-					add_char(&s, c);
+				if (in_quote(s, QT_SINGLE))
+					add_char(s, c);
+				else if (s->last_char_backslash) {
+					s->last_char_backslash = FALSE;
+					add_char(s, c);
 				}
 				else
-					i = string->len;    /* Break out of loop. */
+					s->done = TRUE;
 				break;
 
 			case (';'):     /* These are command finishers. */
 			case ('&'):     /* Must be careful not to include one if not */
 			case ('|'):     /* escaped, and to stop processing if so. */
-				if (in_quote(&s, QT_SINGLE) || in_quote(&s, QT_DOUBLE) ||
-						in_quote(&s, QT_EXTGLOB_PAREN))
-					add_char(&s, c);
-				else if (s.last_char_backslash) {
-					s.last_char_backslash = FALSE;
-					add_char(&s, c);
+				if (in_quote(s, QT_SINGLE) || in_quote(s, QT_DOUBLE) ||
+						in_quote(s, QT_EXTGLOB_PAREN))
+					add_char(s, c);
+				else if (s->last_char_backslash) {
+					s->last_char_backslash = FALSE;
+					add_char(s, c);
 				}
 				else
-					i = string->len;    /* Break out of loop. */
+					s->done = TRUE;
 				break;
 
 			case ('\015'):  /* Carriage return */
@@ -275,45 +360,61 @@ gchar* sanitize(GString* string) {
 
 			case ('>'):
 			case ('<'):
-				if (in_quote(&s, QT_SINGLE) || in_quote(&s, QT_DOUBLE) ||
-						in_quote(&s, QT_EXTGLOB_PAREN))
-					add_char(&s, c);
-				else if (s.last_char_backslash) {
-					s.last_char_backslash = FALSE;
-					add_char(&s, c);
+				if (in_quote(s, QT_SINGLE) || in_quote(s, QT_DOUBLE) ||
+						in_quote(s, QT_EXTGLOB_PAREN))
+					add_char(s, c);
+				else if (s->last_char_backslash) {
+					s->last_char_backslash = FALSE;
+					add_char(s, c);
 				}
 				else {    /* Break out of loop. */
 					/* Note: this isn't entirely correct, as bash only
 					   interprets a few characters as being part of the
 					   redirection construct. */
-					delete_current_word(&s);
-					i = string->len;
+					delete_current_word(s);
+					s->done = TRUE;
 				}
 				break;
 
 			default:
-				if (s.last_char_backslash)
-					s.last_char_backslash = FALSE;
-				add_char(&s, c);
+				if (s->last_char_backslash)
+					s->last_char_backslash = FALSE;
+				add_char(s, c);
 				break;
 		}
+
+		if ( (c == ' ' || c == '\t') && !s->done ) {
+			s->out = s->command->len;
+			s->checkpoints = g_array_append_val(s->checkpoints, *s);
+		}
 	}
+}
 
-	if (s.last_char_backslash) {
+
+/* Tidy up the end of the command, in a copy so that the lexer can carry on
+   from where it was next time. */
+static gchar* finish(struct sane_cmd* s) {
+	struct sane_cmd f = *s;
+	gchar c;
+
+	f.command = g_string_new_len(s->command->str, s->command->len);
+	f.checkpoints = NULL;
+
+	if (f.last_char_backslash) {
 		/* Can't have a trailing backslash. */
-		backspace(&s);
-		s.last_char_backslash = FALSE;
+		backspace(&f);
+		f.last_char_backslash = FALSE;
 	}
 
 	/* Close unclosed quotes. */
 	enum quote_type qt;
-	while ( (qt = ql_pop(&s)) != QT_DUMMY ) {
+	while ( (qt = ql_pop(&f)) != QT_DUMMY ) {
 
-		if (s.last_char_exclamation) {
+		if (f.last_char_exclamation) {
 			/* This exclamation could be interpreted as special because of
 			   the following quote characters. */
-			backspace(&s);
-			s.last_char_exclamation = FALSE;
+			backspace(&f);
+			f.last_char_exclamation = FALSE;
 		}
 		
 		switch (qt) {
@@ -331,12 +432,10 @@ gchar* sanitize(GString* string) {
 				c = ' ';
 				break;
 		}
-		add_char(&s, c);
+		add_char(&f, c);
 	}
 	
-	gchar* retval = s.command->str;
-	g_string_free(s.command, FALSE);
-	return retval;
+	return g_string_free(f.command, FALSE);
 }
 
 
@@ -365,33 +464,28 @@ static void add_char(struct sane_cmd* s, gchar c) {
 
 
 static enum quote_type ql_pop(struct sane_cmd* s) {
-	enum quote_type popped;
-	if (s->ql) {
-		struct quote_list* tmp = s->ql->next;
-		popped = s->ql->qt;
-		g_free(s->ql);
-		s->ql = tmp;
-	}
+	if (s->ql_len > 0)
+		return s->ql[--s->ql_len];
 	else
-		popped = QT_DUMMY;
-
-	return popped;
+		return QT_DUMMY;
 }
 
 
-static void ql_push(struct sane_cmd* s, enum quote_type new_qt) {
-	struct quote_list* new_ql;
+/* Returns FALSE (and stops the lexer) if the quotes are nested too deep. */
+static gboolean ql_push(struct sane_cmd* s, enum quote_type new_qt) {
+	if (s->ql_len == QUOTE_DEPTH) {
+		s->done = TRUE;
+		return FALSE;
+	}
 
-	new_ql = g_new(struct quote_list, 1);
-	new_ql->qt = new_qt;
-	new_ql->next = s->ql;
-	s->ql = new_ql;
+	s->ql[s->ql_len++] = new_qt;
+	return TRUE;
 }
 
 
 static gboolean in_quote(struct sane_cmd* s, enum quote_type qt) {
-	if (s->ql) {
-		if (s->ql->qt == qt)
+	if (s->ql_len > 0) {
+		if (s->ql[s->ql_len - 1] == qt)
 			return TRUE;
 		else
 			return FALSE;
@@ -406,5 +500,12 @@ static void backspace(struct sane_cmd* s) {
 
 	if (s->command->len > 0)
 		s->command = g_string_truncate(s->command, s->command->len - 1);
+
+	/* A checkpoint past this point no longer has its output. */
+	while (s->checkpoints && s->checkpoints->len > 0 &&
+			g_array_index(s->checkpoints, struct sane_cmd,
+				s->checkpoints->len - 1).out > s->command->len) {
+		g_array_set_size(s->checkpoints, s->checkpoints->len - 1);
+	}
 }
 
@@ -25,7 +25,14 @@
 G_BEGIN_DECLS
 
 
-gchar* sanitize(GString* string);
+struct sanitizer;
+
+struct sanitizer* sanitizer_new(void);
+void              sanitizer_free(struct sanitizer* z);
+
+gchar* sanitize(const gchar* string, gsize len);
+gchar* sanitize_from(struct sanitizer* z, const gchar* string, gsize len,
+		gsize changed);
 
 
 G_END_DECLS
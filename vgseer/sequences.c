@@ -27,26 +27,43 @@
 #include <string.h>
 #include <ctype.h>
 
+#define MAX_LEADS 8
+
 typedef struct _Sequence Sequence;
 struct _Sequence {
 	gchar* name;	            /* For debugging. */
 	gchar* seq;
 	const gint length;
-	gint pos;
-
-	/* Determines whether a match should be attempted. */
-	gboolean enabled;
 
 	/* Function to run after successful match. */
 	MatchEffect (*func)(Connection* b, struct cmdline* cmd);
 };
 
+/* Entries of a SeqGroup's table other than a next state. */
+#define DFA_NO_MATCH    (-1)
+#define DFA_MATCH(i)    (-2 - (i))     /* The group's i'th sequence. */
+#define DFA_MATCHED(t)  (-2 - (t))
+
 /* Each process level has a set of sequences that it checks for.  This
    struct is for these sets. */
 typedef struct _SeqGroup SeqGroup;
 struct _SeqGroup {
 	gint n;                 /* Number of sequences. */
 	Sequence** seqs;
+
+	/* The sequences compiled into one automaton (see compile_group()):
+	   row s of the table says, for each byte, what follows it in state s.
+	   State 0 is the start. */
+	gint16* table;
+	gint n_states;
+	gint state;
+
+	/* The bytes which can begin one of the sequences, so that the ones in
+	   between can be skipped without trying each sequence on them.  If
+	   there are too many to list, any byte might. */
+	gint n_leads;
+	guchar leads[MAX_LEADS];
+	gboolean any_lead;
 };
 
 
@@ -56,7 +73,10 @@ static gchar*  parse_printables(const gchar* string, const gchar* sequence);
 
 static void init_bash_seqs(void);
 static void init_zsh_seqs(void);
-static MatchStatus check_seq(gchar c, Sequence* sq);
+static void compile_group(SeqGroup* group);
+static gint step_seq(const Sequence* sq, gint pos, guchar c);
+static void find_leads(SeqGroup* group);
+static gboolean is_lead(const SeqGroup* group, guchar c);
 static void analyze_effect(MatchEffect effect, Connection* b,
 		struct cmdline* cmd);
 
@@ -112,22 +132,22 @@ static MatchEffect seq_term_newline(Connection* b, struct cmdline* cmd);
 static Sequence PS1_SEPARATOR_SEQ = {
 	"ps1 separator seq",
 	STR_LEN_PAIR("\033[0;30m\033[0m\033[1;37m\033[0m"),
-	0, FALSE, seq_ps1_separator,
+	seq_ps1_separator,
 };
 static Sequence RPROMPT_SEPARATOR_START_SEQ = {
 	"RPROMPT separator start",
 	STR_LEN_PAIR("\033[0;34m\033[0m\033[0;31m\033[0m"),
-	0, FALSE, seq_rprompt_separator_start,
+	seq_rprompt_separator_start,
 };
 static Sequence RPROMPT_SEPARATOR_END_SEQ = {
 	"RPROMPT separator end",
 	STR_LEN_PAIR("\033[0;34m\033[0m\033[0;31m\033[0m" "\033[" DIGIT_S "D"),
-	0, FALSE, seq_rprompt_separator_end,
+	seq_rprompt_separator_end,
 };
 static Sequence NEW_PWD_SEQ = {
 	"New pwd",
 	STR_LEN_PAIR("\033P" PRINTABLE_S "\033\\"),
-	0, FALSE, seq_new_pwd,
+	seq_new_pwd,
 };
 
 
@@ -135,14 +155,14 @@ static Sequence NEW_PWD_SEQ = {
 static Sequence CTRL_G_SEQ = {
 	"Ctrl-G",
 	STR_LEN_PAIR("\007"),
-	0, FALSE, seq_ctrl_g,
+	seq_ctrl_g,
 };
 
 /* We examine every key on an individual basis in Viewglob mode. */
 static Sequence VIEWGLOB_ALL_SEQ = {
 	"Viewglob seq",
 	STR_LEN_PAIR(ANY_S),
-	0, FALSE, seq_viewglob_all,
+	seq_viewglob_all,
 };
 
 
@@ -151,7 +171,7 @@ static Sequence VIEWGLOB_ALL_SEQ = {
 static Sequence ZSH_COMPLETION_DONE_SEQ = {
 	"Zsh completion done",
 	STR_LEN_PAIR("\033[0m\033[27m\033[24m\015\033[" DIGIT_S "C"),
-	0, FALSE, seq_zsh_completion_done,
+	seq_zsh_completion_done,
 };
 
 /* Terminal escape sequences that we have to watch for.
@@ -160,57 +180,57 @@ static Sequence ZSH_COMPLETION_DONE_SEQ = {
 static Sequence TERM_CMD_WRAPPED_SEQ = {
 	"Term cmd wrapped",
 	STR_LEN_PAIR(" \015" NOT_LF_CR_S ""),
-	0, FALSE, seq_term_cmd_wrapped,
+	seq_term_cmd_wrapped,
 };
 static Sequence TERM_CARRIAGE_RETURN_SEQ = {
 	"Term carriage return",
 	STR_LEN_PAIR("\015" NOT_LF_S ""),
-	0, FALSE, seq_term_carriage_return,
+	seq_term_carriage_return,
 };
 static Sequence TERM_NEWLINE_SEQ = {
 	"Term newline",
 	STR_LEN_PAIR("\015\n"),
-	0, FALSE, seq_term_newline,
+	seq_term_newline,
 };
 static Sequence TERM_BACKSPACE_SEQ  = {
 	"Term backspace",
 	STR_LEN_PAIR("\010"),
-	0, FALSE, seq_term_backspace,
+	seq_term_backspace,
 };
 static Sequence TERM_CURSOR_FORWARD_SEQ = {
 	"Term cursor forward",
 	STR_LEN_PAIR("\033[" DIGIT_S "C"),
-	0, FALSE, seq_term_cursor_forward,
+	seq_term_cursor_forward,
 };
 static Sequence TERM_CURSOR_BACKWARD_SEQ = {
 	"Term cursor backward",
 	STR_LEN_PAIR("\033[" DIGIT_S "D"),
-	0, FALSE, seq_term_cursor_backward,
+	seq_term_cursor_backward,
 };
 static Sequence TERM_CURSOR_UP_SEQ  = {
 	"Term cursor up",
 	STR_LEN_PAIR("\033[" DIGIT_S "A"),
-	0, FALSE, seq_term_cursor_up,
+	seq_term_cursor_up,
 };
 static Sequence TERM_ERASE_IN_LINE_SEQ = {
 	"Term erase in line",
 	STR_LEN_PAIR("\033[" DIGIT_S "K"),
-	0, FALSE, seq_term_erase_in_line,
+	seq_term_erase_in_line,
 };
 static Sequence TERM_DELETE_CHARS_SEQ = {
 	"Term delete chars",
 	STR_LEN_PAIR("\033[" DIGIT_S "P"),
-	0, FALSE, seq_term_delete_chars,
+	seq_term_delete_chars,
 };
 static Sequence TERM_INSERT_BLANKS_SEQ = {
 	"Term insert blanks",
 	STR_LEN_PAIR("\033[" DIGIT_S "@"),
-	0, FALSE, seq_term_insert_blanks,
+	seq_term_insert_blanks,
 };
 static Sequence TERM_BELL_SEQ = {
 	"Term bell",
 	STR_LEN_PAIR("\007"),
-	0, FALSE, seq_term_bell,
+	seq_term_bell,
 };
 
 
@@ -276,7 +296,9 @@ static gchar* parse_printables(const gchar* string, const gchar* sequence) {
    in different groups instead of referenced, which should be fixed. */
 void init_seqs(enum shell_type shell) {
 
-	seq_groups = g_new(SeqGroup, PL_COUNT);
+	enum process_level pl;
+
+	seq_groups = g_new0(SeqGroup, PL_COUNT);
 	if (shell == ST_BASH)
 		init_bash_seqs();
 	else if (shell == ST_ZSH)
@@ -291,7 +313,222 @@ void init_seqs(enum shell_type shell) {
 	seq_groups[PL_VIEWGLOB].n = 1;
 	seq_groups[PL_VIEWGLOB].seqs = g_new(Sequence*, 1);
 	seq_groups[PL_VIEWGLOB].seqs[0] = &VIEWGLOB_ALL_SEQ;
+
+	for (pl = 0; pl < PL_COUNT; pl++) {
+		compile_group(&seq_groups[pl]);
+		find_leads(&seq_groups[pl]);
+	}
+}
+
+
+/* Build the group's automaton.  Its states are the ways the group's
+   sequences can stand part way through a match: for each sequence, how far
+   along it is, or that it's been ruled out.  Starting from all of them at
+   the beginning, every byte is tried on every state found so far, the
+   same way the sequences used to be checked one by one.  The first of the
+   sequences (in the group's order) to be completed by a byte is the match.
+   The sequences are all short, so there aren't many states. */
+#define DEAD_POS 0xFF
+static void compile_group(SeqGroup* group) {
+	GHashTable* numbers;
+	GPtrArray* states;
+	GArray* table;
+	guchar* key;
+	guchar* next;
+	gint16 entry;
+	gint s, c, i, pos;
+	gboolean live;
+
+	numbers = g_hash_table_new(g_str_hash, g_str_equal);
+	states = g_ptr_array_new();
+	table = g_array_new(FALSE, FALSE, sizeof(gint16));
+
+	/* A state is written as a string of each sequence's position + 1. */
+	key = g_malloc(group->n + 1);
+	memset(key, 1, group->n);
+	key[group->n] = '\0';
+	g_ptr_array_add(states, key);
+	g_hash_table_insert(numbers, key, GINT_TO_POINTER(1));
+
+	for (s = 0; s < states->len; s++) {
+		key = g_ptr_array_index(states, s);
+		next = g_malloc(group->n + 1);
+		next[group->n] = '\0';
+
+		for (c = 0; c < 256; c++) {
+			entry = DFA_NO_MATCH;
+			live = FALSE;
+
+			for (i = 0; i < group->n; i++) {
+				if (key[i] == DEAD_POS) {
+					next[i] = DEAD_POS;
+					continue;
+				}
+				pos = step_seq(group->seqs[i], key[i] - 1, c);
+				if (pos == group->seqs[i]->length) {
+					entry = DFA_MATCH(i);
+					break;
+				}
+				else if (pos == -1)
+					next[i] = DEAD_POS;
+				else {
+					next[i] = pos + 1;
+					live = TRUE;
+				}
+			}
+
+			if (entry == DFA_NO_MATCH && live) {
+				entry = GPOINTER_TO_INT(g_hash_table_lookup(numbers, next)) - 1;
+				if (entry == -1) {
+					/* The sequences are fixed, so this would be a bug
+					   rather than something to carry on from with a
+					   half built table. */
+					if (states->len >= G_MAXSHORT)
+						g_error("Too many states in a sequence group");
+					entry = states->len;
+					g_ptr_array_add(states, next);
+					g_hash_table_insert(numbers, next,
+							GINT_TO_POINTER(entry + 1));
+					next = g_malloc(group->n + 1);
+					next[group->n] = '\0';
+				}
+			}
+			g_array_append_val(table, entry);
+		}
+		g_free(next);
+	}
+
+	group->n_states = states->len;
+	group->table = (gint16*) g_array_free(table, FALSE);
+	group->state = 0;
+
+	for (s = 0; s < states->len; s++)
+		g_free(g_ptr_array_index(states, s));
+	g_ptr_array_free(states, TRUE);
+	g_hash_table_destroy(numbers);
+}
+#undef DEAD_POS
+
+
+/* Where the sequence stands after c, having been at pos: the new
+   position, or -1 if c rules it out.  The sequences are assumed to be
+   intelligently chosen and not malformed.  To elaborate:
+   	- Do not have a special character delimiter after a special character.
+	- Do not end a sequence with a special character. */
+static gint step_seq(const Sequence* sq, gint pos, guchar c) {
+
+	switch (sq->seq[pos]) {
+		case ANY_C:
+			return pos + 1;
+
+		case DIGIT_C:
+			if (isdigit(c))
+				return pos;
+			else if ((guchar) sq->seq[pos + 1] == c) {
+				/* Skip over special char and delimiter. */
+				return pos + 2;
+			}
+			else
+				return -1;
+
+		case PRINTABLE_C:
+			/*if (isprint(c))*/
+			if (!iscntrl(c))  /* Quick hack for UTF-8 characters. */
+				return pos;
+			else if ((guchar) sq->seq[pos + 1] == c) {
+				/* Skip over special char and delimiter. */
+				return pos + 2;
+			}
+			else
+				return -1;
+
+		case NOT_LF_C:
+			return c == '\012' ? -1 : pos + 1;
+
+		case NOT_LF_CR_C:
+			/* Linefeed or carriage return. */
+			return c == '\012' || c == '\015' ? -1 : pos + 1;
+
+		default:
+			return (guchar) sq->seq[pos] == c ? pos + 1 : -1;
+	}
+}
+
+
+/* Collect the bytes which lead anywhere from the start state. */
+static void find_leads(SeqGroup* group) {
+	gint c;
+
+	group->n_leads = 0;
+	group->any_lead = FALSE;
+
+	for (c = 0; c < 256; c++) {
+		if (group->table[c] == DFA_NO_MATCH)
+			continue;
+		if (group->n_leads == MAX_LEADS) {
+			group->any_lead = TRUE;
+			return;
+		}
+		group->leads[group->n_leads++] = c;
+	}
+}
+
+
+static gboolean is_lead(const SeqGroup* group, guchar c) {
+	return memchr(group->leads, c, group->n_leads) != NULL;
+}
+
+
+/* Count the bytes at the start of buf which can't begin any of pl's
+   sequences.  Command output is mostly made of these, so they're looked
+   at a word at a time: a byte of the word equals c exactly when that byte
+   of (word ^ c repeated) is zero, and there's a standard trick for
+   spotting a zero byte. */
+#define ONES       (~0UL / 0xFF)
+#define HIGHS      (ONES << 7)
+#define HAS_ZERO(x) (((x) - ONES) & ~(x) & HIGHS)
+gsize count_inert(enum process_level pl, const gchar* buf, gsize len) {
+	const SeqGroup* group = &seq_groups[pl];
+	const guchar* p = (const guchar*) buf;
+	const guchar* end = p + len;
+	const guchar* hit;
+	gulong word;
+	gint i;
+
+	if (group->any_lead)
+		return 0;
+	if (group->n_leads == 0)
+		return len;
+
+	/* A lone lead is what memchr() is for. */
+	if (group->n_leads == 1) {
+		hit = memchr(p, group->leads[0], len);
+		return hit ? (gsize) (hit - p) : len;
+	}
+
+	while (p < end && ((gulong) p % sizeof(gulong)) != 0) {
+		if (is_lead(group, *p))
+			return p - (const guchar*) buf;
+		p++;
+	}
+
+	while (end - p >= (glong) sizeof(gulong)) {
+		memcpy(&word, p, sizeof(word));
+		for (i = 0; i < group->n_leads; i++) {
+			if (HAS_ZERO(word ^ (ONES * group->leads[i])))
+				goto found;
+		}
+		p += sizeof(gulong);
+	}
+
+found:
+	while (p < end && !is_lead(group, *p))
+		p++;
+	return p - (const guchar*) buf;
 }
+#undef ONES
+#undef HIGHS
+#undef HAS_ZERO
 
 
 static void init_bash_seqs(void) {
@@ -365,136 +602,36 @@ static void init_zsh_seqs(void) {
 }
 
 
-static void disable_seq(Sequence* sq) {
-	sq->enabled = FALSE;
-	sq->pos = 0;
-}
-
-
-void disable_all_seqs(enum process_level pl) {
-	gint i;
-	for (i = 0; i < seq_groups[pl].n; i++)
-		disable_seq(seq_groups[pl].seqs[i]);
-}
-
-void enable_all_seqs(enum process_level pl) {
-	gint i;
-	for (i = 0; i < seq_groups[pl].n; i++)
-		seq_groups[pl].seqs[i]->enabled = TRUE;
-}
-
-
+/* Feed the next byte of the segment to the automaton for b's process
+   level, and act on any match.  Either way, the next byte after a match or
+   a failure starts over. */
 void check_seqs(Connection* b, struct cmdline* cmd) {
-	gint i;
 	MatchEffect effect;
+	Sequence* seq;
+	gint16 entry;
 
-	gchar c = b->buf[b->pos + b->seglen];
-	SeqGroup seq_group = seq_groups[b->pl];
-
-	b->status = MS_NO_MATCH;
-	for (i = 0; i < seq_group.n; i++) {
-
-		Sequence* seq = *(seq_group.seqs + i);
-
-		b->status |= check_seq(c, seq);
-		if (b->status & MS_MATCH) {
+	guchar c = b->buf[b->pos + b->seglen];
+	SeqGroup* group = &seq_groups[b->pl];
 
-			/* Execute the pattern match function and analyze. */
-			effect = (*(seq->func))(b, cmd);
-
-			analyze_effect(effect, b, cmd);
-
-			break;
-		}
+	entry = group->table[group->state * 256 + c];
+	if (entry >= 0) {
+		group->state = entry;
+		b->status = MS_IN_PROGRESS;
+		return;
 	}
-}
-
-
-/* Assumes that the sequences are intelligently chosen and are not
-   malformed.  To elaborate:
-   	- Do not have a special character delimiter after a special character.
-	- Do not end a sequence with a special character.
-
-   This function is poorly written, but it works.  */
-static MatchStatus check_seq(gchar c, Sequence* sq) {
-
-	MatchStatus result = MS_IN_PROGRESS;
-
-	/* This sequence is disabled right now -- assume no match. */
-	if (sq->enabled == FALSE)
-		return MS_NO_MATCH;
-
-	switch (sq->seq[sq->pos]) {
-		case ANY_C:
-			sq->pos++;
-			break;
-
-		case DIGIT_C:
-			if (isdigit(c))
-				return MS_IN_PROGRESS;
-			else if (sq->seq[sq->pos + 1] == c) {
-				/* Skip over special char and delimiter. */
-				sq->pos += 2;
-			}
-			else {
-				sq->pos = 0;
-				disable_seq(sq);
-				return MS_NO_MATCH;
-			}
-			break;
-
-		case PRINTABLE_C:
-			/*if (isprint(c))*/
-			if (!iscntrl(c))  /* Quick hack for UTF-8 characters. */
-				return MS_IN_PROGRESS;
-			else if (sq->seq[sq->pos + 1] == c) {
-				/* Skip over special char and delimiter. */
-				sq->pos += 2;
-			}
-			else {
-				sq->pos = 0;
-				disable_seq(sq);
-				return MS_NO_MATCH;
-			}
-			break;
 
-		case NOT_LF_C:
-			if (c == '\012') {
-				sq->pos = 0;
-				disable_seq(sq);
-				return MS_NO_MATCH;
-			}
-			else
-				sq->pos++;
-			break;
-
-		case NOT_LF_CR_C:
-			/* Linefeed or carriage return. */
-			if (c == '\012' || c == '\015') {
-				sq->pos = 0;
-				disable_seq(sq);
-				return MS_NO_MATCH;
-			}
-			else
-				sq->pos++;
-			break;
-
-		default:
-			if (sq->seq[sq->pos] == c)
-				sq->pos++;
-			else {
-				sq->pos = 0;
-				disable_seq(sq);
-				return MS_NO_MATCH;
-			}
-			break;
+	group->state = 0;
+	if (entry == DFA_NO_MATCH) {
+		b->status = MS_NO_MATCH;
+		return;
 	}
 
-	if (sq->pos == sq->length) {
-		sq->pos = 0;
-		result = MS_MATCH;
-	}
-	return result;
+	b->status = MS_MATCH;
+	seq = group->seqs[DFA_MATCHED(entry)];
+
+	/* Execute the pattern match function and analyze. */
+	effect = (*(seq->func))(b, cmd);
+	analyze_effect(effect, b, cmd);
 }
 
 
@@ -553,11 +690,9 @@ static void analyze_effect(MatchEffect effect, Connection* b,
 }
 
 
+/* Abandon any match in progress. */
 void clear_seqs(enum process_level pl) {
-	gint i;
-	for (i = 0; i < seq_groups[pl].n; i++)
-		seq_groups[pl].seqs[i]->pos = 0;
-	return;
+	seq_groups[pl].state = 0;
 }
 
 
@@ -758,9 +893,9 @@ static MatchEffect seq_term_cursor_up(Connection* b, struct cmdline* cmd) {
 	MatchEffect effect = ME_NO_EFFECT;
 	gint i, n;
 	gint offset;
-	gchar* last_cr_p;
-	gchar* next_cr_p;
-	gchar* pos;
+	gint last_cr;
+	gint next_cr;
+	gint pos;
 
 	n = parse_digits(b->buf + b->pos, b->seglen + 1);
 	if (n == 0) {
@@ -768,24 +903,23 @@ static MatchEffect seq_term_cursor_up(Connection* b, struct cmdline* cmd) {
 		n = 1;
 	}
 
-	last_cr_p = g_strrstr_len(cmd->data->str, cmd->pos, "\015");
-	next_cr_p = g_strstr_len(cmd->data->str + cmd->pos,
-			cmd->data->len - cmd->pos, "\015");
-	if (!last_cr_p && !next_cr_p)
+	last_cr = cmd_find_CR(cmd, cmd->pos, D_LEFT);
+	next_cr = cmd_find_CR(cmd, cmd->pos, D_RIGHT);
+	if (last_cr == -1 && next_cr == -1)
 		goto out_of_prompt;
 
 	/* First try to find the ^M at the beginning of the wanted line. */
-	if (last_cr_p) {
+	if (last_cr != -1) {
 
-		pos = cmd->data->str + cmd->pos;
-		for (i = 0; i < n + 1 && pos != NULL; i++)
-			pos = g_strrstr_len(cmd->data->str, pos - cmd->data->str, "\015");
+		pos = cmd->pos;
+		for (i = 0; i < n + 1 && pos != -1; i++)
+			pos = cmd_find_CR(cmd, pos, D_LEFT);
 
-		if (pos != NULL) {
+		if (pos != -1) {
 			/* Cursor is offset chars from the beginning of the line. */
-			offset = cmd->data->str + cmd->pos - last_cr_p;
+			offset = cmd->pos - last_cr;
 			/* Position cursor on new line at same position. */
-			cmd->pos = pos + offset - cmd->data->str;
+			cmd->pos = pos + offset;
 			if (cmd->pos >= 0) {
 				effect = ME_NO_EFFECT;
 				goto done;
@@ -797,17 +931,17 @@ static MatchEffect seq_term_cursor_up(Connection* b, struct cmdline* cmd) {
 
 	/* That failed, so now try to find the ^M at the end of the wanted
 	   line. */
-	if (next_cr_p != NULL) {
+	if (next_cr != -1) {
 
-		pos = cmd->data->str + cmd->pos;
-		for (i = 0; i < n && pos != NULL; i++)
-			pos = g_strrstr_len(cmd->data->str, pos - cmd->data->str, "\015");
+		pos = cmd->pos;
+		for (i = 0; i < n && pos != -1; i++)
+			pos = cmd_find_CR(cmd, pos, D_LEFT);
 
-		if (pos != NULL) {
+		if (pos != -1) {
 			/* Cursor is offset chars from the end of the line. */
-			offset = next_cr_p - cmd->data->str - cmd->pos;
+			offset = next_cr - cmd->pos;
 			/* Position cursor on new line at same position. */
-			cmd->pos = pos - offset - cmd->data->str;
+			cmd->pos = pos - offset;
 			if (cmd->pos >= 0) {
 				effect = ME_NO_EFFECT;
 				goto done;
@@ -833,21 +967,21 @@ static MatchEffect seq_term_cursor_up(Connection* b, struct cmdline* cmd) {
 static MatchEffect seq_term_carriage_return(Connection* b,
 		struct cmdline* cmd) {
 	MatchEffect effect;
-	gchar* p;
+	gint p;
 
 	if (cmd->expect_newline) {
 		effect = ME_CMD_EXECUTED;
 		pass_segment(b);
 	}
 	else {
-		p = g_strrstr_len(cmd->data->str, cmd->pos, "\015");
-		if (!p) {
+		p = cmd_find_CR(cmd, cmd->pos, D_LEFT);
+		if (p == -1) {
 			cmd->pos = 0;
 			effect = ME_CMD_REBUILD;
 		}
 		else {
 			/* Go to the character just after the ^M. */
-			cmd->pos = p - cmd->data->str + 1;
+			cmd->pos = p + 1;
 			effect = ME_NO_EFFECT;
 		}
 
@@ -866,19 +1000,18 @@ static MatchEffect seq_term_carriage_return(Connection* b,
    is interpreted as a command execution.  If not, then it is
    a command line wrap. */
 static MatchEffect seq_term_newline(Connection* b, struct cmdline* cmd) {
-	gchar* p;
+	gint p;
 	MatchEffect effect;
 
-	p = g_strstr_len(cmd->data->str + cmd->pos, cmd->data->len - cmd->pos,
-			"\015");
-	if (!p) {
+	p = cmd_find_CR(cmd, cmd->pos, D_RIGHT);
+	if (p == -1) {
 		if (cmd->expect_newline) {
 			/* Command must have been executed. */
 			effect = ME_CMD_EXECUTED;
 		}
 		else {
 			/* Newline must just be a wrap. */
-			cmd->pos = cmd->data->len;
+			cmd->pos = cmd_length(cmd);
 			if (cmd_overwrite_char(cmd, '\015', FALSE))
 				effect = ME_NO_EFFECT;
 			else
@@ -886,7 +1019,7 @@ static MatchEffect seq_term_newline(Connection* b, struct cmdline* cmd) {
 		}
 	}
 	else {
-		cmd->pos = p - cmd->data->str + 1;
+		cmd->pos = p + 1;
 		effect = ME_NO_EFFECT;
 	}
 	pass_segment(b);
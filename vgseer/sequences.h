@@ -44,9 +44,8 @@ enum _MatchEffect {
 /* Sequence functions. */
 void  init_seqs(enum shell_type shell);
 void  check_seqs(Connection* b, struct cmdline* cmd);
-void  enable_all_seqs(enum process_level pl);
-void  disable_all_seqs(enum process_level pl);
 void  clear_seqs(enum process_level pl);
+gsize count_inert(enum process_level pl, const gchar* buf, gsize len);
 
 G_END_DECLS
 
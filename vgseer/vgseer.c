@@ -32,6 +32,8 @@
 #include "logging.h"
 #include "fgetopt.h"
 #include "conf-to-args.h"
+#include "expand.h"
+#include "glob-match.h"
 
 #include <stdio.h>
 #include <signal.h>
@@ -58,6 +60,17 @@
 
 #define CONF_FILE         ".viewglob/vgseer.conf"
 
+/* Longest an expansion waits on directories before sending what it has (in
+   ms).  The rest are sent once they've been read. */
+#define EXPAND_BUDGET     200
+
+/* Longest a change to the command line waits to be expanded while more
+   keystrokes are coming (in ms). */
+#define COALESCE_MAX      150
+
+/* A gap between keystrokes longer than this (in ms) isn't typing. */
+#define COALESCE_IDLE     1000
+
 /* Structure for the state of the user's shell. */
 struct user_state {
 	struct cmdline cmd;
@@ -65,8 +78,10 @@ struct user_state {
 	struct child shell;
 	struct child sandbox;
 	enum shell_type type;
+	guint glob_options;          /* GLOB_OPT_*, from the sandbox. */
 
 	gchar* vgexpand_opts;
+	gboolean vgd_takes_deltas;   /* vgd accepted EXPAND_DELTA_OFFER. */
 };
 
 /* Structure for data relevant to communicating with vgd. */
@@ -74,8 +89,34 @@ struct vgd_stuff {
 	int fd;
 	Connection* shell_conn;
 	Connection* term_conn;
+	GString* args;           /* NUL-delimited arguments to expand, */
+	gboolean args_are_words; /* as typed, or expanded by the sandbox shell. */
+	GString* frame;          /* Arguments still coming from the sandbox, */
+	gboolean in_frame;       /* once the start of them has been seen. */
 	GString* expanded;
-	gboolean vgexpand_called;
+	GString* sent;           /* The last results vgd was given, */
+	guint32 generation;      /* and how many it's been given so far. */
+	GString* delta;
+	gboolean send_deltas;
+	guint32 request;         /* Id of the latest expansion request, */
+	guint32 sandbox_request; /* of the one the sandbox is working on (0 if */
+	GTimeVal sandbox_sent;   /* none), and when that was sent. */
+	GString* sandbox_cmd;    /* The command for it, whether it's been */
+	gboolean sandbox_written; /* written to the sandbox yet, and whether */
+	gboolean sandbox_resent;  /* it's had to be written twice. */
+	gboolean sandbox_busy;   /* The sandbox has a command to finish, */
+	GTimeVal sandbox_started; /* given to it at this time, */
+	gboolean sandbox_interrupted; /* and it's been sent SIGINT since. */
+	gchar* expand_pwd;       /* Context of the outstanding expansion. */
+	gchar* expand_mask;
+
+	/* Scheduling of expansions (see schedule_vgexpand()). */
+	GTimeVal last_change;    /* When the command line last changed. */
+	glong cadence;           /* Typical gap between keystrokes (ms). */
+	glong latency;           /* Typical time an expansion takes (ms). */
+	gboolean expand_due;     /* An expansion has been put off */
+	GTimeVal due_since;      /* since this time, */
+	GTimeVal fire_at;        /* until this one. */
 };
 
 /* Program argument options. */
@@ -114,6 +155,11 @@ static void     send_status(enum shell_status ss, struct vgd_stuff* vgd);
 static void     child_wait(struct user_state* u);
 static void     process_shell(struct user_state* u, Connection* cnct);
 static void     process_sandbox(struct user_state* u, struct vgd_stuff* vgd);
+static void     sandbox_ready(struct user_state* u, struct vgd_stuff* vgd);
+static void     set_glob_options(struct user_state* u, const GString* frame);
+static void     expand_args(struct vgd_stuff* vgd);
+static void     send_results(struct vgd_stuff* vgd);
+static void     process_watches(struct vgd_stuff* vgd);
 static void     process_terminal(struct user_state* u, Connection* cnct);
 static void     process_vgd(struct user_state* u, struct vgd_stuff* vgd);
 static gboolean scan_for_newline(const Connection* b);
@@ -127,8 +173,16 @@ static gint connect_to_vgd(gchar* server, gchar* port,
 		gboolean use_unix_socket, struct user_state* u);
 static gboolean set_term_title(gint fd, gchar* title);
 static gchar*   escape_filename(gchar* name, struct user_state* u,
-		enum process_level pl, gchar* holdover);
+		enum process_level pl, const Connection* term);
+static void    schedule_vgexpand(struct user_state* u, struct vgd_stuff* vgd);
+static void    fire_vgexpand(struct user_state* u, struct vgd_stuff* vgd);
+static glong   vgexpand_timeout(const struct vgd_stuff* vgd);
+static void    note_latency(struct vgd_stuff* vgd, const GTimeVal* start);
+static glong   elapsed_ms(const GTimeVal* from, const GTimeVal* to);
 static void    call_vgexpand(struct user_state* u, struct vgd_stuff* vgd);
+static void    send_to_sandbox(struct user_state* u, struct vgd_stuff* vgd);
+static void    cancel_sandbox(struct user_state* u, struct vgd_stuff* vgd);
+static gboolean awaiting_sandbox(const struct vgd_stuff* vgd);
 static void put_param_wrapped(gint fd, enum parameter param, gchar* value);
 
 static void report_version(void);
@@ -153,6 +207,10 @@ gint main(gint argc, gchar** argv) {
 
 	gint vgd_fd;
 	
+	/* Directories are read on a pool of threads (see expand.c). */
+	if (!g_thread_supported())
+		g_thread_init(NULL);
+
 	/* Set the program name. */
 	gchar* basename = g_path_get_basename(argv[0]);
 	g_set_prgname(basename);
@@ -195,6 +253,9 @@ gint main(gint argc, gchar** argv) {
 	u.shell.exec_name = u.sandbox.exec_name = opts.executable;
 	u.type = opts.shell;
 
+	/* Until the sandbox says otherwise, don't glob anything natively. */
+	u.glob_options = GLOB_OPT_FOREIGN;
+
 	/* Create the shells. */
 	if (!fork_shell(&u.shell, u.type, FALSE, opts.init_loc))
 		clean_fail(NULL);
@@ -265,14 +326,17 @@ static gint connect_to_vgd(gchar* server, gchar* port,
 
 	enum parameter param;
 	gchar* value = NULL;
+	gchar** accepted;
+	gchar** iter;
+	gboolean binary = FALSE;
 
 	/* Send over information. */
 	put_param_verify(fd, P_PURPOSE, "vgseer");
 	put_param_verify(fd, P_VERSION, VERSION);
-	put_param_verify(fd, P_TERM_TITLE, term_title);
 
-	/* Wait for acknowledgement. */
+	/* Check the acknowledgement. */
 	get_param_verify(fd, &param, &value, P_STATUS, NULL);
+	u->vgd_takes_deltas = FALSE;
 	if (STREQ(value, "ERROR")) {
 		/* Print reason for error and exit. */
 		get_param_verify(fd, &param, &value, P_REASON, NULL);
@@ -288,6 +352,32 @@ static gint connect_to_vgd(gchar* server, gchar* port,
 		g_critical("Unknown value for P_STATUS: %s", value);
 		clean_fail(NULL);
 	}
+	else {
+		/* Same version, so vgd knows about offers.  Offer binary framing
+		   and expansion deltas, and see which it takes. */
+		put_param_verify(fd, P_OFFER,
+				PARAM_FRAMING_OFFER " " EXPAND_DELTA_OFFER);
+		get_param_verify(fd, &param, &value, P_OFFER, NULL);
+
+		accepted = g_strsplit(value, " ", 0);
+		for (iter = accepted; *iter; iter++) {
+			if (STREQ(*iter, PARAM_FRAMING_OFFER))
+				binary = TRUE;
+			else if (STREQ(*iter, EXPAND_DELTA_OFFER))
+				u->vgd_takes_deltas = TRUE;
+		}
+		g_strfreev(accepted);
+
+		/* Deltas only come in binary. */
+		if (binary) {
+			param_io_set_framing(fd, PF_BINARY);
+			expand_set_format(EF_BINARY);
+		}
+		else
+			u->vgd_takes_deltas = FALSE;
+	}
+
+	put_param_verify(fd, P_TERM_TITLE, term_title);
 
 	/* Wait for vgd to tell us to set our title. */
 	get_param_verify(fd, &param, &value, P_ORDER, "set-title");
@@ -305,6 +395,8 @@ static gint connect_to_vgd(gchar* server, gchar* port,
 	get_param_verify(fd, &param, &value, P_VGEXPAND_OPTS, NULL);
 
 	u->vgexpand_opts = g_strdup(value);
+	expand_set_opts(u->vgexpand_opts);
+	expand_set_budget(EXPAND_BUDGET);
 
 	/* It's safe to change the title to something else now. */
 	if (!set_term_title(STDOUT_FILENO, "viewglob"))
@@ -477,17 +569,20 @@ static void main_loop(struct user_state* u, gint vgd_fd) {
 	g_return_if_fail(u != NULL);
 	g_return_if_fail(vgd_fd >= 0);
 
-	gchar common_buf[BUFSIZ];
+	/* Each connection keeps its holdover in its own buffer between
+	   reads. */
+	gchar term_buf[BUFSIZ];
+	gchar shell_buf[BUFSIZ];
 
 	/* Terminal reads from stdin and writes to the shell. */
 	Connection term_conn;
 	connection_init(&term_conn, "terminal", STDIN_FILENO, u->shell.fd_out,
-			common_buf, sizeof(common_buf), PL_TERMINAL);
+			term_buf, sizeof(term_buf), PL_TERMINAL);
 
 	/* Reads from shell and writes to stdout. */
 	Connection shell_conn;
 	connection_init(&shell_conn, "shell", u->shell.fd_in, STDOUT_FILENO,
-			common_buf, sizeof(common_buf), PL_EXECUTING);
+			shell_buf, sizeof(shell_buf), PL_EXECUTING);
 
 	/* When dealing with vgd we have to access data from a bunch of
 	   different places. */
@@ -495,8 +590,31 @@ static void main_loop(struct user_state* u, gint vgd_fd) {
 	vgd.fd = vgd_fd;
 	vgd.term_conn = &term_conn;
 	vgd.shell_conn = &shell_conn;
-	vgd.expanded = g_string_sized_new(sizeof(common_buf));
-	vgd.vgexpand_called = FALSE;
+	vgd.args = g_string_sized_new(BUFSIZ);
+	vgd.args_are_words = FALSE;
+	vgd.frame = g_string_sized_new(BUFSIZ);
+	vgd.in_frame = FALSE;
+	vgd.expanded = g_string_sized_new(BUFSIZ);
+	vgd.sent = g_string_sized_new(BUFSIZ);
+	vgd.generation = 0;
+	vgd.delta = g_string_new(NULL);
+	vgd.send_deltas = u->vgd_takes_deltas;
+	vgd.request = 0;
+	vgd.sandbox_request = 0;
+	vgd.sandbox_cmd = g_string_new(NULL);
+	vgd.sandbox_written = FALSE;
+	vgd.sandbox_resent = FALSE;
+	/* It's busy starting up until its first prompt, and that's not to be
+	   interrupted. */
+	vgd.sandbox_busy = TRUE;
+	g_get_current_time(&vgd.sandbox_started);
+	vgd.sandbox_interrupted = TRUE;
+	vgd.expand_pwd = NULL;
+	vgd.expand_mask = NULL;
+	g_get_current_time(&vgd.last_change);
+	vgd.cadence = COALESCE_IDLE;
+	vgd.latency = 0;
+	vgd.expand_due = FALSE;
 
 	gboolean in_loop = TRUE;
 	while (in_loop) {
@@ -549,8 +667,8 @@ static gboolean action_loop(struct user_state* u, struct vgd_stuff* vgd) {
 				break;
 
 			case A_SEND_CMD:
-				call_vgexpand(u, vgd);
-				/* The parameters were already sent. */
+				schedule_vgexpand(u, vgd);
+				/* The parameters were already sent (or will be). */
 				param = P_NONE;
 				value = NULL;
 				break;
@@ -571,6 +689,8 @@ static gboolean action_loop(struct user_state* u, struct vgd_stuff* vgd) {
 				break;
 
 			case A_SEND_LOST:
+				/* The command line isn't worth expanding anymore. */
+				vgd->expand_due = FALSE;
 				vgd->shell_conn->ss = SS_LOST;
 				param = P_NONE;
 				break;
@@ -614,6 +734,7 @@ static gboolean action_loop(struct user_state* u, struct vgd_stuff* vgd) {
 		value = NULL;
 	}
 
+	fire_vgexpand(u, vgd);
 	return TRUE;
 }
 
@@ -649,6 +770,8 @@ static void io_activity(struct user_state* u, Connection* shell_conn,
 
 	fd_set rset;
 	gint max_fd = -1;
+	gint watch_fd;
+	gint pending_fd;
 
 	/* Setup polling. */
 	// TODO kill sandbox shell on disable.
@@ -661,10 +784,19 @@ static void io_activity(struct user_state* u, Connection* shell_conn,
 		FD_SET(vgd->fd, &rset);
 		max_fd = MAX(MAX(max_fd, vgd->fd), u->sandbox.fd_in);
 	}
+	watch_fd = expand_watch_fd();
+	if (vgseer_enabled && watch_fd != -1) {
+		FD_SET(watch_fd, &rset);
+		max_fd = MAX(max_fd, watch_fd);
+	}
+	pending_fd = expand_pending_fd();
+	if (vgseer_enabled && pending_fd != -1) {
+		FD_SET(pending_fd, &rset);
+		max_fd = MAX(max_fd, pending_fd);
+	}
 
-	/* Wait for readable data. */
-	//FIXME set a time limit to see what happens
-	if (hardened_select(max_fd + 1, &rset, -1) == -1) {
+	/* Wait for readable data, or until a put-off expansion is due. */
+	if (hardened_select(max_fd + 1, &rset, vgexpand_timeout(vgd)) == -1) {
 		g_critical("Problem while waiting for input: %s", g_strerror(errno));
 		clean_fail(NULL);
 	}
@@ -677,6 +809,23 @@ static void io_activity(struct user_state* u, Connection* shell_conn,
 		process_vgd(u, vgd);
 	if (FD_ISSET(u->sandbox.fd_in, &rset))
 		process_sandbox(u, vgd);
+	if ((watch_fd != -1 && FD_ISSET(watch_fd, &rset)) ||
+			(pending_fd != -1 && FD_ISSET(pending_fd, &rset)))
+		process_watches(vgd);
+}
+
+
+/* Something changed in a directory we've listed, or one the last expansion
+   had to go without has now been read.  If it affects what's being shown
+   and there's no expansion already on the way, redo the last one so the
+   display keeps up while the command line is idle. */
+static void process_watches(struct vgd_stuff* vgd) {
+
+	g_return_if_fail(vgd != NULL);
+
+	if (expand_process_events() && !awaiting_sandbox(vgd) &&
+			vgd->expand_pwd != NULL)
+		expand_args(vgd);
 }
 
 
@@ -725,6 +874,15 @@ static gssize sandbox_read(int fd, gchar* buf, gsize len) {
 }
 
 
+/* Take whatever the sandbox shell has written.  The arguments vgargs echoes
+   back come between '\002' and '\003', and may take several reads to
+   arrive; rather than waiting on them here, they're collected a read at a
+   time so the terminal and vgd aren't held up in the meantime.  Once the
+   '\003' is in, they're expanded and sent off -- unless they're for a
+   request which has since been superseded.  The first argument is the
+   request's id (see call_vgexpand()).  Each time the shell gets back to its
+   prompt it writes a '\005' (see sandbox_ready()), and before its first
+   prompt it writes a frame with id 0 (see set_glob_options()). */
 static void process_sandbox(struct user_state* u, struct vgd_stuff* vgd) {
 
 	g_return_if_fail(u != NULL);
@@ -732,49 +890,198 @@ static void process_sandbox(struct user_state* u, struct vgd_stuff* vgd) {
 
 	static gchar buf[BUFSIZ];
 	gssize nread;
+	gchar* p;
+	gchar* end;
+	gchar* delim;
+	gchar* restart;
+	gchar* ready;
+	GString* tmp;
+	guint32 id;
+	gboolean wanted;
 
 	if ((nread = sandbox_read(u->sandbox.fd_in, buf, sizeof(buf))) < 0)
 		return;
 
-	if (vgd->vgexpand_called) {
-		gchar* start = NULL;
-		gchar* end = NULL;
-		gsize len;
-		vgd->expanded = g_string_set_size(vgd->expanded, 0);
-
-		/* Locate the start of the expand data */
-		while (TRUE) {
-			start = g_strstr_len(buf, nread, "\002");
-			if (start)
+	/* The arguments are NUL delimited, so no str* functions. */
+	p = buf;
+	end = buf + nread;
+	while (p < end) {
+		if (!vgd->in_frame) {
+			/* Anything outside the delimiters is just the shell's chatter,
+			   apart from its prompts. */
+			for (; p < end && *p != '\002'; p++) {
+				if (*p == '\005')
+					sandbox_ready(u, vgd);
+			}
+			if (p == end)
 				break;
-			if ((nread = sandbox_read(u->sandbox.fd_in, buf, sizeof(buf))) < 0)
-				return;
+			vgd->frame = g_string_truncate(vgd->frame, 0);
+			vgd->in_frame = TRUE;
+			p++;
+			continue;
 		}
-		start++;
-		len = buf + nread - start;
 
-		/* Find the end of the data and copy everything along the way. */
-		while (TRUE) {
-			end = g_strstr_len(start, len, "\003");
-			if (end)
-				break;
-			vgd->expanded = g_string_append_len(vgd->expanded, start, len);
-			if ((nread = sandbox_read(u->sandbox.fd_in, buf, sizeof(buf))) < 0)
-				return;
-			start = buf;
-			len = nread;
+		delim = memchr(p, '\003', end - p);
+
+		/* A frame cut short by cancel_sandbox() never gets its '\003'.
+		   Drop it when the shell's back at its prompt, or the next one
+		   starts. */
+		restart = memchr(p, '\002', (delim ? delim : end) - p);
+		ready = memchr(p, '\005', (restart ? restart : delim ? delim : end)
+				- p);
+		if (ready)
+			restart = ready;
+		if (restart) {
+			vgd->in_frame = FALSE;
+			p = restart;
+		}
+		else if (!delim) {
+			vgd->frame = g_string_append_len(vgd->frame, p, end - p);
+			break;
 		}
-		vgd->expanded = g_string_append_len(vgd->expanded, start,
-				end - start);
+		else {
+			vgd->frame = g_string_append_len(vgd->frame, p, delim - p);
+			vgd->in_frame = FALSE;
+			p = delim + 1;
+
+			id = strtoul(vgd->frame->str, NULL, 10);
+			if (id == 0) {
+				set_glob_options(u, vgd->frame);
+				continue;
+			}
+
+			/* A request which had to be resent may be answered twice. */
+			wanted = id == vgd->sandbox_request && id == vgd->request;
+			if (id == vgd->sandbox_request)
+				vgd->sandbox_request = 0;
+
+			/* Now we have the whole command line -- expand it and send it
+			   off, if it's still wanted. */
+			if (wanted) {
+				tmp = vgd->args;
+				vgd->args = vgd->frame;
+				vgd->frame = tmp;
+				vgd->args = g_string_erase(vgd->args, 0,
+						MIN(strlen(vgd->args->str) + 1, vgd->args->len));
+				vgd->args_are_words = FALSE;
+				expand_args(vgd);
+				note_latency(vgd, &vgd->sandbox_sent);
+			}
+		}
+	}
+}
 
-		/* Now we have the whole output of vgexpand -- let's send it off. */
-		put_param_wrapped(vgd->fd, P_VGEXPAND_DATA, vgd->expanded->str);
 
-		vgd->vgexpand_called = FALSE;
+/* The sandbox shell is back at its prompt, having finished (or been
+   interrupted out of) the one command it was given.  If the latest request
+   is still waiting on it, either it was held back until now, or the
+   command went without answering -- e.g. thrown away by an interrupt.
+   Either way, send it now.  It's only resent the once, since a command
+   which can't succeed (e.g. cd'ing to a directory that's gone) never
+   answers at all. */
+static void sandbox_ready(struct user_state* u, struct vgd_stuff* vgd) {
+
+	g_return_if_fail(u != NULL);
+	g_return_if_fail(vgd != NULL);
+
+	vgd->sandbox_busy = FALSE;
+	vgd->sandbox_interrupted = FALSE;
+	if (!awaiting_sandbox(vgd))
+		return;
+
+	if (!vgd->sandbox_written)
+		send_to_sandbox(u, vgd);
+	else if (!vgd->sandbox_resent) {
+		vgd->sandbox_resent = TRUE;
+		send_to_sandbox(u, vgd);
 	}
 }
 
 
+/* The sandbox lists the shell options which change what a glob matches
+   that are on (it has the user's run-control files, so it has their
+   options too).  Only extglob is understood here; any of the others means
+   globs have to be left to the sandbox. */
+static void set_glob_options(struct user_state* u, const GString* frame) {
+
+	g_return_if_fail(u != NULL);
+	g_return_if_fail(frame != NULL);
+
+	const gchar* p = frame->str + strlen(frame->str) + 1;
+	const gchar* end = frame->str + frame->len;
+
+	u->glob_options = 0;
+	for (; p < end; p += strlen(p) + 1) {
+		if (STREQ(p, "extglob"))
+			u->glob_options |= GLOB_OPT_EXTGLOB;
+		else
+			u->glob_options |= GLOB_OPT_FOREIGN;
+	}
+}
+
+
+/* Send the new results to vgd, as a delta from the last ones if that's
+   smaller. */
+static void send_results(struct vgd_stuff* vgd) {
+
+	g_return_if_fail(vgd != NULL);
+
+	GString* results = vgd->expanded;
+	GString* tmp;
+
+	if (vgd->send_deltas && vgd->sent->len > 0 &&
+			expand_delta_make(vgd->delta, vgd->sent, vgd->generation,
+				vgd->expanded) &&
+			vgd->delta->len < vgd->expanded->len)
+		results = vgd->delta;
+
+	/* The results may be binary. */
+	if (!put_param_len(vgd->fd, P_VGEXPAND_DATA, results->str,
+				results->len)) {
+		g_critical("Couldn't send parameter");
+		clean_fail(NULL);
+	}
+	vgd->generation++;
+
+	/* Keep these results to make the next delta from. */
+	tmp = vgd->sent;
+	vgd->sent = vgd->expanded;
+	vgd->expanded = tmp;
+}
+
+
+/* Run the expansion engine over the NUL-delimited arguments (either the
+   command line's words or what the sandbox shell made of them) and pass the
+   result on to vgd. */
+static void expand_args(struct vgd_stuff* vgd) {
+
+	g_return_if_fail(vgd != NULL);
+	g_return_if_fail(vgd->expand_pwd != NULL);
+	g_return_if_fail(vgd->expand_mask != NULL);
+
+	GPtrArray* argv = g_ptr_array_new();
+	gchar* p = vgd->args->str;
+	gchar* end = vgd->args->str + vgd->args->len;
+
+	while (p < end) {
+		g_ptr_array_add(argv, p);
+		p += strlen(p) + 1;
+	}
+
+	vgd->expanded = g_string_set_size(vgd->expanded, 0);
+	if (vgd->args_are_words) {
+		if (expand_words(vgd->expanded, vgd->expand_pwd, vgd->expand_mask,
+					argv->len, (gchar**) argv->pdata) && vgseer_enabled)
+			send_results(vgd);
+	}
+	else if (expand(vgd->expanded, vgd->expand_pwd, vgd->expand_mask,
+				argv->len, (gchar**) argv->pdata) && vgseer_enabled)
+		send_results(vgd);
+
+	g_ptr_array_free(argv, TRUE);
+}
+
+
 static void process_terminal(struct user_state* u, Connection* cnct) {
 
 	/* Prepend holdover from last terminal read. */
@@ -822,7 +1129,7 @@ static void process_vgd(struct user_state* u, struct vgd_stuff* vgd) {
 
 		case P_FILE:
 			value = escape_filename(value, u, vgd->shell_conn->pl,
-					vgd->term_conn->holdover);
+					vgd->term_conn);
 			len = strlen(value);
 			break;
 
@@ -835,6 +1142,17 @@ static void process_vgd(struct user_state* u, struct vgd_stuff* vgd) {
 			}
 			break;
 
+		case P_ORDER:
+			/* vgd lost track of the deltas, so start over with the full
+			   results. */
+			if (STREQ(value, "full-expansion")) {
+				vgd->sent = g_string_truncate(vgd->sent, 0);
+				if (!awaiting_sandbox(vgd) && vgd->expand_pwd != NULL)
+					expand_args(vgd);
+			}
+			return;
+			/*break;*/
+
 		case P_EOF:
 			g_critical("vgd closed its connection");
 		case P_STATUS:
@@ -875,15 +1193,20 @@ static void scan_sequences(Connection* b, struct user_state* u) {
 
 		cmd_del_trailing_CRs(&u->cmd);
 
-		if (!IN_PROGRESS(b->status))
-			enable_all_seqs(b->pl);
+		/* Skip straight over anything that can't start a sequence.  At the
+		   prompt, each byte has to go into the command line, so there it's
+		   not worth it. */
+		if (!IN_PROGRESS(b->status) && b->seglen == 0 &&
+				b->pl != PL_AT_PROMPT) {
+			b->pos += count_inert(b->pl, b->buf + b->pos,
+					b->filled - b->pos);
+			if (b->pos == b->filled)
+				break;
+		}
 
 		check_seqs(b, &u->cmd);
 
-		if (b->status & MS_MATCH)
-			clear_seqs(b->pl);
-
-		else if (b->status & MS_IN_PROGRESS)
+		if (b->status & MS_IN_PROGRESS)
 			b->seglen++;
 
 		else if (b->status & MS_NO_MATCH) {
@@ -906,7 +1229,7 @@ static void scan_sequences(Connection* b, struct user_state* u) {
 	if (IN_PROGRESS(b->status)) {
 		if (b->pl == PL_AT_PROMPT
 				&& b->seglen == 1 && b->buf[b->pos] == ' ') {
-			disable_all_seqs(PL_AT_PROMPT);
+			clear_seqs(PL_AT_PROMPT);
 			b->status = MS_NO_MATCH;
 			cmd_overwrite_char(&u->cmd, b->buf[b->pos], FALSE);
 			action_queue(A_SEND_CMD);
@@ -919,21 +1242,24 @@ static void scan_sequences(Connection* b, struct user_state* u) {
 
 /* Look for characters which can break a line. */
 static gboolean scan_for_newline(const Connection* b) {
-	gsize i;
-
-	for (i = 0; i < b->filled; i++) {
-		switch ( *(b->buf + i) ) {
-			case '\n':     /* Newline. */
-			case '\t':     /* Horizontal tab (for tab completion with
-			                  multiple potential hits). */
-			case '\003':   /* End of text -- Ctrl-C. */
-			case '\004':   /* End of transmission -- Ctrl-D. */
-			case '\015':   /* Carriage return -- this is the Enter key. */
-			case '\017':   /* Shift in -- Ctrl-O (operate-and-get-next in
-			                  bash readline). */
-				return TRUE;
-			default:
-				break;
+	gsize i, end;
+	guint n;
+
+	for (n = 0; connection_span(b, n, &i, &end); n++) {
+		for (; i < end; i++) {
+			switch ( *(b->buf + i) ) {
+				case '\n':     /* Newline. */
+				case '\t':     /* Horizontal tab (for tab completion with
+				                  multiple potential hits). */
+				case '\003':   /* End of text -- Ctrl-C. */
+				case '\004':   /* End of transmission -- Ctrl-D. */
+				case '\015':   /* Carriage return -- this is the Enter key. */
+				case '\017':   /* Shift in -- Ctrl-O (operate-and-get-next in
+				                  bash readline). */
+					return TRUE;
+				default:
+					break;
+			}
 		}
 	}
 
@@ -945,7 +1271,7 @@ static gboolean scan_for_newline(const Connection* b) {
    it requires peeking at the terminal's holdover, the shell's process
    level, and the command line's current state. */
 static gchar* escape_filename(gchar* name, struct user_state* u,
-		enum process_level pl, gchar* holdover) {
+		enum process_level pl, const Connection* term) {
 	gchar c;
 	gchar* retval;
 
@@ -954,7 +1280,8 @@ static gchar* escape_filename(gchar* name, struct user_state* u,
 	if (pl == PL_AT_PROMPT) {
 		/* If there's no whitespace to the left, add a space at the
 		   beginning. */
-		if (!cmd_whitespace_to_left(&u->cmd, holdover))
+		if (!cmd_whitespace_to_left(&u->cmd, term->buf + term->pos,
+					term->ho_len))
 			escaped = g_string_append_c(escaped, ' ');
 	}
 
@@ -1063,36 +1390,163 @@ static void send_term_size(gint shell_fd) {
 }
 
 
-/* Emits commands of the following form to the sandbox shell:
-		cd "<pwd>" && vgexpand <opts> -m "<mask>" -- <cmd> ; cd / */
+/* The command line has changed.  Expanding it on every keystroke is a
+   waste when they're coming faster than expansions finish (or paste is
+   coming in), so changes are coalesced:
+	- A change after a quiet spell is expanded right away, so a single
+	  keypress costs no extra latency.
+	- Changes that follow it closely are put off until the typing pauses
+	  (a gap half again as long as the usual one between keystrokes), but
+	  not for longer than the window.
+   The window grows with how long expansions have been taking, so a slow
+   filesystem sees fewer of them, up to COALESCE_MAX. */
+static void schedule_vgexpand(struct user_state* u, struct vgd_stuff* vgd) {
+	GTimeVal now;
+	glong gap, window, pause;
+
+	g_get_current_time(&now);
+	gap = elapsed_ms(&vgd->last_change, &now);
+	vgd->last_change = now;
+	if (gap < COALESCE_IDLE)
+		vgd->cadence = (3 * vgd->cadence + gap) / 4;
+
+	window = MIN(2 * vgd->latency, COALESCE_MAX);
+
+	/* Leading edge. */
+	if (!vgd->expand_due && gap > window) {
+		call_vgexpand(u, vgd);
+		return;
+	}
+
+	/* Trailing edge. */
+	if (!vgd->expand_due) {
+		vgd->expand_due = TRUE;
+		vgd->due_since = now;
+	}
+	pause = MIN(window, vgd->cadence + vgd->cadence / 2);
+	vgd->fire_at = now;
+	g_time_val_add(&vgd->fire_at, pause * 1000);
+	if (elapsed_ms(&vgd->due_since, &vgd->fire_at) > window) {
+		vgd->fire_at = vgd->due_since;
+		g_time_val_add(&vgd->fire_at, window * 1000);
+	}
+}
+
+
+/* Do the put-off expansion if its time has come. */
+static void fire_vgexpand(struct user_state* u, struct vgd_stuff* vgd) {
+	if (vgd->expand_due && vgexpand_timeout(vgd) == 0) {
+		vgd->expand_due = FALSE;
+		if (vgseer_enabled)
+			call_vgexpand(u, vgd);
+	}
+}
+
+
+/* How long to wait before the put-off expansion is due (in ms), or -1 if
+   there isn't one. */
+static glong vgexpand_timeout(const struct vgd_stuff* vgd) {
+	GTimeVal now;
+
+	if (!vgd->expand_due)
+		return -1;
+
+	g_get_current_time(&now);
+	return MAX(elapsed_ms(&now, &vgd->fire_at), 0);
+}
+
+
+/* Fold the time since start into the typical expansion time. */
+static void note_latency(struct vgd_stuff* vgd, const GTimeVal* start) {
+	GTimeVal now;
+
+	g_get_current_time(&now);
+	vgd->latency = (3 * vgd->latency + elapsed_ms(start, &now)) / 4;
+}
+
+
+static glong elapsed_ms(const GTimeVal* from, const GTimeVal* to) {
+	return (to->tv_sec - from->tv_sec) * 1000 +
+		(to->tv_usec - from->tv_usec) / 1000;
+}
+
+
+/* Expand the command line.  Usually its words are globbed right here
+   against the cached listings, but if glob_split() doesn't trust itself
+   with them, commands of the following form are emitted to the sandbox
+   shell:
+		cd "<pwd>" && vgargs <id> <cmd> ; cd /
+   vgargs is a shell function which just echoes back its (expanded)
+   arguments, so the sandbox doesn't have to fork anything.  The expansion
+   itself is done in process_sandbox() once the arguments arrive.
+
+   Each call is a new request with its own id.  Anything the sandbox is
+   still working on for an older one is of no further use. */
 static void call_vgexpand(struct user_state* u, struct vgd_stuff* vgd) {
 
 	static GString* mask_prev = NULL;
 	if (!mask_prev)
 		mask_prev = g_string_new(NULL);
 
+	/* Keeps its place in the command line from one call to the next, so
+	   only the part that's been edited is gone over again. */
+	static struct sanitizer* cmd_sanitizer = NULL;
+	if (!cmd_sanitizer)
+		cmd_sanitizer = sanitizer_new();
+
+	const gchar* line;
+	gsize changed;
 	gchar* cmd_sane;
 	gchar* mask_sane;
-	gchar* expand_command;
-
-	cmd_sane = sanitize(u->cmd.data);
-
-	mask_sane = sanitize(u->cmd.mask_final);
+	gchar** words;
+	gchar** word;
+	GTimeVal start;
+
+	g_get_current_time(&start);
+	line = cmd_text(&u->cmd, &changed);
+	cmd_sane = sanitize_from(cmd_sanitizer, line,
+			cmd_length(&u->cmd), changed);
+	vgd->request++;
+	cancel_sandbox(u, vgd);
+
+	mask_sane = sanitize(u->cmd.mask_final->str, u->cmd.mask_final->len);
 	/* A blank mask may as well be "*" */
 	if (strlen(mask_sane) == 0) {
 		g_free(mask_sane);
 		mask_sane = g_strdup("*");
 	}
 
-	expand_command = g_strconcat("cd \'", u->cmd.pwd,
-			"\' && vgexpand -m \'", mask_sane, "\' ", u->vgexpand_opts,
-			" -- ", cmd_sane, " ; cd /\n", NULL);
-
-	if (write_all(u->sandbox.fd_out, expand_command,
-				strlen(expand_command)) == IOR_ERROR)
-		disable_vgseer(vgd);
+	words = glob_split(cmd_sane, u->type, u->glob_options);
+	if (words) {
+		vgd->args = g_string_set_size(vgd->args, 0);
+		for (word = words; *word; word++)
+			vgd->args = g_string_append_len(vgd->args, *word,
+					strlen(*word) + 1);
+		vgd->args_are_words = TRUE;
+		g_strfreev(words);
+	}
+	else {
+		g_string_printf(vgd->sandbox_cmd,
+				"cd \'%s\' && vgargs %u %s ; cd /\n",
+				u->cmd.pwd, vgd->request, cmd_sane);
+		vgd->sandbox_request = vgd->request;
+		vgd->sandbox_written = FALSE;
+		vgd->sandbox_resent = FALSE;
+		g_get_current_time(&vgd->sandbox_sent);
+
+		/* The sandbox only ever has one command at a time, so nothing
+		   written to it can be lost behind an interrupt meant for
+		   another.  If it's busy, sandbox_ready() sends this once it's
+		   done. */
+		if (!vgd->sandbox_busy)
+			send_to_sandbox(u, vgd);
+	}
 
-	vgd->vgexpand_called = TRUE;
+	/* Remember what the arguments will be expanded against. */
+	g_free(vgd->expand_pwd);
+	g_free(vgd->expand_mask);
+	vgd->expand_pwd = g_strdup(u->cmd.pwd);
+	vgd->expand_mask = g_strdup(mask_sane);
 
 	/* Send the command line. */
 	put_param_wrapped(vgd->fd, P_CMD, cmd_sane);
@@ -1103,12 +1557,61 @@ static void call_vgexpand(struct user_state* u, struct vgd_stuff* vgd) {
 	/*	mask_prev = g_string_assign(mask_prev, mask_sane);*/
 	/*}*/
 
-	g_free(expand_command);
+	/* The results follow the command line they belong to. */
+	if (!awaiting_sandbox(vgd)) {
+		expand_args(vgd);
+		note_latency(vgd, &start);
+	}
+
 	g_free(mask_sane);
 	g_free(cmd_sane);
 }
 
 
+/* Give the sandbox the command for the request waiting on it. */
+static void send_to_sandbox(struct user_state* u, struct vgd_stuff* vgd) {
+
+	g_return_if_fail(u != NULL);
+	g_return_if_fail(vgd != NULL);
+
+	if (write_all(u->sandbox.fd_out, vgd->sandbox_cmd->str,
+				vgd->sandbox_cmd->len) == IOR_ERROR)
+		disable_vgseer(vgd);
+
+	vgd->sandbox_written = TRUE;
+	vgd->sandbox_busy = TRUE;
+	g_get_current_time(&vgd->sandbox_started);
+}
+
+
+/* A new request has come along, so whatever the sandbox is working on is
+   pointless.  Usually it'll be done soon enough, and its answer is just
+   dropped when it turns up.  But if it's been at it for longer than an
+   expansion is given (e.g. globbing a huge tree), interrupt it, so the new
+   request doesn't wait on it.  A request which hasn't been sent yet is
+   simply replaced. */
+static void cancel_sandbox(struct user_state* u, struct vgd_stuff* vgd) {
+	GTimeVal now;
+
+	if (!vgd->sandbox_busy || vgd->sandbox_interrupted ||
+			u->sandbox.pid == -1)
+		return;
+
+	g_get_current_time(&now);
+	if (elapsed_ms(&vgd->sandbox_started, &now) > EXPAND_BUDGET) {
+		(void) kill(u->sandbox.pid, SIGINT);
+		vgd->sandbox_interrupted = TRUE;
+	}
+}
+
+
+/* Whether the latest request's arguments are still to come from the
+   sandbox. */
+static gboolean awaiting_sandbox(const struct vgd_stuff* vgd) {
+	return vgd->sandbox_request != 0 && vgd->sandbox_request == vgd->request;
+}
+
+
 static gboolean fork_shell(struct child* child, enum shell_type type,
 		gboolean sandbox, gchar* init_loc) {
 